@@ -659,12 +659,8 @@ int docmd_clsigma(arg_struct *arg) {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
-    for (i = first; i < last; i++) {
-        if (r->array->is_string[i] == 2)
-            free(*(void **) &r->array->data[i]);
-        r->array->is_string[i] = 0;
-        r->array->data[i] = 0;
-    }
+    for (i = first; i < last; i++)
+        put_matrix_real(r, i, 0);
     flags.f.log_fit_invalid = 0;
     flags.f.exp_fit_invalid = 0;
     flags.f.pwr_fit_invalid = 0;
@@ -733,11 +729,12 @@ int docmd_clrg(arg_struct *arg) {
             return ERR_INSUFFICIENT_MEMORY;
         rm = (vartype_realmatrix *) regs;
         sz = rm->rows * rm->columns;
-        free_long_strings(rm->array->is_string, rm->array->data, sz);
+        free_matrix_strings(rm->array);
         for (i = 0; i < sz; i++)
             rm->array->data[i] = 0;
         for (i = 0; i < sz; i++)
             rm->array->is_string[i] = 0;
+        rm->array->string_count = 0;
         return ERR_NONE;
     } else if (regs->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm;
@@ -163,6 +163,45 @@ int docmd_fcc_t(arg_struct *arg) {
     }
 }
 
+/* COMB, PERM, and N! multiply their results together one factor at a time,
+ * which keeps them exact when they are representable. The number of factors
+ * can be huge, and while the products overflow long before the loops get far,
+ * that can still take tens of thousands of steps in the decimal build. When
+ * Stirling's approximation of the log of the result says it is going to
+ * overflow anyway, we skip the loop. The margin of 1 absorbs the error in
+ * the approximation, which is tiny in the range of arguments where this
+ * check is made.
+ */
+#ifdef BCD_MATH
+#define LN_MAX_PHLOAT 14149.38
+#else
+#define LN_MAX_PHLOAT 709.78
+#endif
+
+static phloat ln_fact(phloat n) {
+    if (n < 1)
+        return 0;
+    return n * log(n) - n + log(2 * PI * n) / 2 + 1 / (12 * n);
+}
+
+static bool certain_overflow(phloat y, phloat x, bool comb) {
+    if (y > 1e12)
+        // Too big for the difference below to be accurate; but factors
+        // this big make the product loops overflow quickly anyway.
+        return false;
+    phloat ln = ln_fact(y) - ln_fact(y - x);
+    if (comb)
+        ln -= ln_fact(x);
+    return ln > LN_MAX_PHLOAT + 1;
+}
+
+static int overflow_result(phloat *r) {
+    if (!flags.f.range_error_ignore)
+        return ERR_OUT_OF_RANGE;
+    *r = POS_HUGE_PHLOAT;
+    return ERR_NONE;
+}
+
 int docmd_comb(arg_struct *arg) {
     phloat y = ((vartype_real *) stack[sp - 1])->x;
     phloat x = ((vartype_real *) stack[sp])->x;
@@ -174,6 +213,12 @@ int docmd_comb(arg_struct *arg) {
         return ERR_INVALID_DATA;
     if (x > y / 2)
         x = y - x;
+    if (certain_overflow(y, x, true)) {
+        int err = overflow_result(&r);
+        if (err != ERR_NONE)
+            return err;
+        goto done;
+    }
     #ifdef BCD_MATH
         s = x == 0 ? 1 : pow(10, 1 + floor(log10(x)));
     #else
@@ -198,6 +243,7 @@ int docmd_comb(arg_struct *arg) {
         else
             return ERR_OUT_OF_RANGE;
     }
+    done:
     v = new_real(r);
     if (v == NULL)
         return ERR_INSUFFICIENT_MEMORY;
@@ -213,6 +259,12 @@ int docmd_perm(arg_struct *arg) {
         return ERR_INVALID_DATA;
     if (y < x)
         return ERR_INVALID_DATA;
+    if (certain_overflow(y, x, false)) {
+        int err = overflow_result(&r);
+        if (err != ERR_NONE)
+            return err;
+        x = 0;
+    }
     while (x > 0) {
         r *= y--;
         if (p_isinf(r)) {
@@ -234,6 +286,8 @@ static int mappable_fact(phloat x, phloat *y) {
     phloat f = 1;
     if (x < 0 || x != floor(x))
         return ERR_INVALID_DATA;
+    if (certain_overflow(x, x, false))
+        return overflow_result(y);
     while (x > 1) {
         f *= x--;
         if (p_isinf(f)) {
@@ -284,19 +284,14 @@ int docmd_cross(arg_struct *arg) {
         vartype_realmatrix *right = (vartype_realmatrix *) stack[sp];
         int4 ls = left->rows * left->columns;
         int4 rs = right->rows * right->columns;
-        int4 i;
         int inf;
         phloat xl, yl = 0, zl = 0, xr, yr = 0, zr = 0;
         phloat xres, yres, zres;
         vartype_realmatrix *res;
         if (ls > 3 || rs > 3)
             return ERR_DIMENSION_ERROR;
-        for (i = 0; i < ls; i++)
-            if (left->array->is_string[i] != 0)
-                return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < rs; i++)
-            if (right->array->is_string[i] != 0)
-                return ERR_ALPHA_DATA_IS_INVALID;
+        if (contains_strings(left) || contains_strings(right))
+            return ERR_ALPHA_DATA_IS_INVALID;
         switch (ls) {
             case 3: zl = left->array->data[2];
             case 2: yl = left->array->data[1];
@@ -352,7 +347,7 @@ int docmd_delr(arg_struct *arg) {
     vartype_realmatrix *rm;
     vartype_complexmatrix *cm;
     vartype_list *list;
-    int4 rows, columns, i, j, n, newi;
+    int4 rows, columns, i, n, newi;
     int err, refcount;
     int interactive;
 
@@ -423,70 +418,26 @@ int docmd_delr(arg_struct *arg) {
     }
 
     if (refcount == 1) {
-        /* We have this array to ourselves so we can modify it in place
-         * We shuffle the array elements around so that if the reallocation
-         * succeeds, everything is in the right place, but if it fails, we
-         * still have all the data so we can roll everything back. And best
-         * of all, no temporary memory allocations needed!
+        /* We have this array to ourselves so we can modify it in place.
+         * Shrinking an unshared matrix always succeeds, so we can simply
+         * move the rows below the deleted one up, and drop the last row.
+         * Long strings in the deleted row are left for the string arena to
+         * reclaim.
          */
+        int4 start = matedit_i * columns;
+        int4 tail = (rows - matedit_i - 1) * columns;
         if (m->type == TYPE_REALMATRIX) {
-            for (j = 0; j < columns; j++) {
-                phloat tempd = rm->array->data[matedit_i * columns + j];
-                char tempc = rm->array->is_string[matedit_i * columns + j];
-                for (i = matedit_i; i < rows - 1; i++) {
-                    rm->array->data[i * columns + j] =
-                                rm->array->data[(i + 1) * columns + j];
-                    rm->array->is_string[i * columns + j] =
-                                rm->array->is_string[(i + 1) * columns + j];
-                }
-                rm->array->data[(rows - 1) * columns + j] = tempd;
-                rm->array->is_string[(rows - 1) * columns + j] = tempc;
-            }
-            err = dimension_array_ref(m, rows - 1, columns);
-            if (err != ERR_NONE) {
-                /* Dang! Now we have to rotate everything back to where
-                 * it was before. */
-                for (j = 0; j < columns; j++) {
-                    phloat tempd = rm->array->data[(rows - 1) * columns + j];
-                    char tempc = rm->array->is_string[(rows - 1) * columns + j];
-                    for (i = rows - 1; i > matedit_i; i--) {
-                        rm->array->data[i * columns + j] =
-                                    rm->array->data[(i - 1) * columns + j];
-                        rm->array->is_string[i * columns + j] =
-                                    rm->array->is_string[(i - 1) * columns + j];
-                    }
-                    rm->array->data[matedit_i * columns + j] = tempd;
-                    rm->array->is_string[matedit_i * columns + j] = tempc;
-                }
-                if (interactive)
-                    free_vartype(newx);
-                return err;
-            }
+            rm->array->string_count -= count_strings(rm->array->is_string + start, columns);
+            memmove(rm->array->is_string + start, rm->array->is_string + start + columns, tail);
+            memmove((void *) (rm->array->data + start), (const void *) (rm->array->data + start + columns), tail * sizeof(phloat));
+            memset(rm->array->is_string + (rows - 1) * columns, 0, columns);
+            dimension_array_ref(m, rows - 1, columns);
         } else if (m->type == TYPE_COMPLEXMATRIX) {
-            for (j = 0; j < 2 * columns; j++) {
-                phloat tempd = cm->array->data[matedit_i * 2 * columns + j];
-                for (i = matedit_i; i < rows - 1; i++)
-                    cm->array->data[i * 2 * columns + j] =
-                                cm->array->data[(i + 1) * 2 * columns + j];
-                cm->array->data[(rows - 1) * 2 * columns + j] = tempd;
-            }
-            err = dimension_array_ref(m, rows - 1, columns);
-            if (err != ERR_NONE) {
-                /* Dang! Now we have to rotate everything back to where
-                 * it was before. */
-                for (j = 0; j < 2 * columns; j++) {
-                    phloat tempd = cm->array->data[(rows - 1) * 2 * columns + j];
-                    for (i = rows - 1; i > matedit_i; i--)
-                        cm->array->data[i * 2 * columns + j] =
-                                    cm->array->data[(i - 1) * 2 * columns + j];
-                    cm->array->data[matedit_i * 2 * columns + j] = tempd;
-                }
-                if (interactive)
-                    free_vartype(newx);
-                return err;
-            }
+            memmove((void *) (cm->array->data + 2 * start), (const void *) (cm->array->data + 2 * (start + columns)), 2 * tail * sizeof(phloat));
+            dimension_array_ref(m, rows - 1, columns);
         } else /* m->type == TYPE_LIST */ {
             /* This one is easy because shrinking an unshared list always succeeds. */
+            invalidate_list_index(list->array);
             vartype *tmp = list->array->data[matedit_i];
             memmove(list->array->data + matedit_i, list->array->data + matedit_i + 1,
                     (rows - matedit_i - 1) * sizeof(vartype *));
@@ -524,17 +475,20 @@ int docmd_delr(arg_struct *arg) {
                 array->is_string[i] = rm->array->is_string[i];
                 array->data[i] = rm->array->data[i];
             }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
-                if (array->is_string[i] == 2)
-                    free(*(void **) &array->data[i]);
             for (i = matedit_i * columns; i < newsize; i++) {
                 array->is_string[i] = rm->array->is_string[i + columns];
                 array->data[i] = rm->array->data[i + columns];
             }
+            array->strings = NULL;
+            share_matrix_strings(array, rm->array);
+            array->string_count = rm->array->string_count
+                    - count_strings(rm->array->is_string + matedit_i * columns, columns);
+            array->capacity = newsize;
             array->refcount = 1;
             rm->array->refcount--;
             rm->array = array;
             rm->rows--;
+            trim_matrix_strings(rm);
         } else if (m->type == TYPE_COMPLEXMATRIX) {
             complexmatrix_data *array = (complexmatrix_data *)
                                 malloc(sizeof(complexmatrix_data));
@@ -554,6 +508,7 @@ int docmd_delr(arg_struct *arg) {
                 array->data[i] = cm->array->data[i];
             for (i = 2 * matedit_i * columns; i < 2 * newsize; i++)
                 array->data[i] = cm->array->data[i + 2 * columns];
+            array->capacity = newsize;
             array->refcount = 1;
             cm->array->refcount--;
             cm->array = array;
@@ -584,6 +539,7 @@ int docmd_delr(arg_struct *arg) {
                     return ERR_INSUFFICIENT_MEMORY;
                 }
             }
+            array->index = NULL;
             array->refcount = 1;
             list->array->refcount--;
             list->array = array;
@@ -656,15 +612,13 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm1 = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *rm2 = (vartype_realmatrix *) stack[sp - 1];
         int4 size = rm1->rows * rm1->columns;
-        int4 i;
-        phloat dot = 0;
+        phloat dot;
         int inf;
         if (size != rm2->rows * rm2->columns)
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm1) || contains_strings(rm2))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++)
-            dot += rm1->array->data[i] * rm2->array->data[i];
+        dot = dot_phloat(rm1->array->data, rm2->array->data, size, 1);
         if ((inf = p_isinf(dot)) != 0) {
             if (flags.f.range_error_ignore)
                 dot = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -679,8 +633,8 @@ int docmd_dot(arg_struct *arg) {
                     && stack[sp - 1]->type == TYPE_REALMATRIX)) {
         vartype_realmatrix *rm;
         vartype_complexmatrix *cm;
-        int4 size, i;
-        phloat dot_re = 0, dot_im = 0;
+        int4 size;
+        phloat dot_re, dot_im;
         int inf;
         if (stack[sp]->type == TYPE_REALMATRIX) {
             rm = (vartype_realmatrix *) stack[sp];
@@ -694,10 +648,8 @@ int docmd_dot(arg_struct *arg) {
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++) {
-            dot_re += rm->array->data[i] * cm->array->data[2 * i];
-            dot_im += rm->array->data[i] * cm->array->data[2 * i + 1];
-        }
+        dot_re = dot_phloat(rm->array->data, cm->array->data, size, 2);
+        dot_im = dot_phloat(rm->array->data, cm->array->data + 1, size, 2);
         if ((inf = p_isinf(dot_re)) != 0) {
             if (flags.f.range_error_ignore)
                 dot_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -1089,11 +1041,7 @@ static int fnrm(vartype *m, phloat *norm) {
         if (s > max_exp)
             max_exp = s;
     }
-    phloat nrm = 0;
-    for (int4 i = 0; i < size; i++) {
-        phloat x = scalbn(data[i], -max_exp);
-        nrm += x * x;
-    }
+    phloat nrm = sum_squares_phloat(data, size, max_exp);
     nrm = scalbn(sqrt(nrm), max_exp);
     if (p_isinf(nrm)) {
         if (flags.f.range_error_ignore)
@@ -1153,24 +1101,18 @@ int docmd_getm(arg_struct *arg) {
         dst = (vartype_realmatrix *) new_realmatrix(y, x);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
+        /* The submatrix shares the source's string arena, so long strings
+         * are copied by pointer, like everything else. */
+        share_matrix_strings(dst->array, src->array);
         for (i = 0; i < y; i++)
             for (j = 0; j < x; j++) {
                 int4 n1 = (i + matedit_i) * src->columns + j + matedit_j;
                 int4 n2 = i * dst->columns + j;
-                if (src->array->is_string[n1] == 2) {
-                    int4 *sp = *(int4 **) &src->array->data[n1];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_vartype((vartype *) dst);
-                        return ERR_INSUFFICIENT_MEMORY;
-                    }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &dst->array->data[n2] = dp;
-                } else {
-                    dst->array->data[n2] = src->array->data[n1];
-                }
+                dst->array->data[n2] = src->array->data[n1];
                 dst->array->is_string[n2] = src->array->is_string[n1];
             }
+        dst->array->string_count = count_strings(dst->array->is_string, x * y);
+        trim_matrix_strings(dst);
         return binary_result((vartype *) dst);
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
         vartype_complexmatrix *src, *dst;
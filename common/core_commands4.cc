@@ -100,21 +100,18 @@ int docmd_insr(arg_struct *arg) {
             return err;
         }
         rows++;
+        int4 start = matedit_i * columns;
+        int4 tail = (rows - matedit_i - 1) * columns;
         if (m->type == TYPE_REALMATRIX) {
-            for (i = rows * columns - 1; i >= (matedit_i + 1) * columns; i--) {
-                rm->array->is_string[i] = rm->array->is_string[i - columns];
-                rm->array->data[i] = rm->array->data[i - columns];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
+            memmove(rm->array->is_string + start + columns, rm->array->is_string + start, tail);
+            memmove((void *) (rm->array->data + start + columns), (const void *) (rm->array->data + start), tail * sizeof(phloat));
+            for (i = start; i < start + columns; i++) {
                 rm->array->is_string[i] = 0;
                 rm->array->data[i] = 0;
             }
         } else if (m->type == TYPE_COMPLEXMATRIX) {
-            for (i = 2 * rows * columns - 1;
-                            i >= 2 * (matedit_i + 1) * columns; i--)
-                cm->array->data[i] = cm->array->data[i - 2 * columns];
-            for (i = 2 * matedit_i * columns;
-                            i < 2 * (matedit_i + 1) * columns; i++)
+            memmove((void *) (cm->array->data + 2 * (start + columns)), (const void *) (cm->array->data + 2 * start), 2 * tail * sizeof(phloat));
+            for (i = 2 * start; i < 2 * (start + columns); i++)
                 cm->array->data[i] = 0;
         } else {
             vartype *v = new_real(0);
@@ -122,6 +119,7 @@ int docmd_insr(arg_struct *arg) {
                 free_vartype(newx);
                 return ERR_INSUFFICIENT_MEMORY;
             }
+            invalidate_list_index(list->array);
             memmove(list->array->data + matedit_i + 1, list->array->data + matedit_i, (rows - matedit_i - 1) * sizeof(vartype *));
             list->array->data[matedit_i] = v;
         }
@@ -176,6 +174,10 @@ int docmd_insr(arg_struct *arg) {
                 array->is_string[i] = rm->array->is_string[i - columns];
                 array->data[i] = rm->array->data[i - columns];
             }
+            array->strings = NULL;
+            share_matrix_strings(array, rm->array);
+            array->string_count = rm->array->string_count;
+            array->capacity = newsize;
             array->refcount = 1;
             rm->array->refcount--;
             rm->array = array;
@@ -202,6 +204,7 @@ int docmd_insr(arg_struct *arg) {
                 array->data[i] = 0;
             for (i = 2 * (matedit_i + 1) * columns; i < 2 * newsize; i++)
                 array->data[i] = cm->array->data[i - 2 * columns];
+            array->capacity = newsize;
             array->refcount = 1;
             cm->array->refcount--;
             cm->array = array;
@@ -234,6 +237,7 @@ int docmd_insr(arg_struct *arg) {
                     return ERR_INSUFFICIENT_MEMORY;
                 }
             }
+            array->index = NULL;
             array->refcount = 1;
             list->array->refcount--;
             list->array = array;
@@ -469,32 +473,33 @@ int docmd_putm(arg_struct *arg) {
         if (src->rows + matedit_i > dst->rows
                 || src->columns + matedit_j > dst->columns)
             return ERR_DIMENSION_ERROR;
-        /* Duplicate and disentangle the source matrix, in order to get
-         * a deep copy with all the long strings replicated; it
-         * simplifies the logic by making rollbacks easier, and it
-         * enables some nice sleight-of-hand for cleaning up the
-         * overwritten entries in the destination as well.
-         */
-        vartype *v = dup_vartype((vartype *) src);
-        if (v == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
-        if (!disentangle(v) || !disentangle(m)) {
-            free_vartype(v);
+        if (!disentangle(m))
             return ERR_INSUFFICIENT_MEMORY;
+        /* Long strings have to end up in the destination's string arena,
+         * unless the two matrices share it already. The space for them is
+         * reserved up front, so the copy cannot fail halfway through.
+         */
+        bool copy_strings = src->array->strings != dst->array->strings;
+        if (copy_strings) {
+            int4 bytes = long_strings_size(src->array->is_string, src->array->data, src->rows * src->columns);
+            if (bytes > 0 && !prepare_matrix_strings(dst, bytes))
+                return ERR_INSUFFICIENT_MEMORY;
         }
-        src = (vartype_realmatrix *) v;
         for (i = 0; i < src->rows; i++)
             for (j = 0; j < src->columns; j++) {
                 int4 n1 = i * src->columns + j;
                 int4 n2 = (i + matedit_i) * dst->columns + j + matedit_j;
-                char tc = dst->array->is_string[n2];
+                if (copy_strings && src->array->is_string[n1] == 2) {
+                    int4 *srcp = *(int4 **) &src->array->data[n1];
+                    int4 *dstp = new_matrix_string(dst->array, *srcp);
+                    memcpy(dstp + 1, srcp + 1, *srcp);
+                    *(int4 **) &dst->array->data[n2] = dstp;
+                } else
+                    dst->array->data[n2] = src->array->data[n1];
+                dst->array->string_count += (src->array->is_string[n1] != 0)
+                                          - (dst->array->is_string[n2] != 0);
                 dst->array->is_string[n2] = src->array->is_string[n1];
-                src->array->is_string[n1] = tc;
-                phloat tp = dst->array->data[n2];
-                dst->array->data[n2] = src->array->data[n1];
-                src->array->data[n1] = tp;
             }
-        free_vartype(v);
         return ERR_NONE;
     } else if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
@@ -586,14 +591,7 @@ int docmd_rnrm(arg_struct *arg) {
             return ERR_ALPHA_DATA_IS_INVALID;
         phloat max = 0;
         for (int4 i = 0; i < rm->rows; i++) {
-            phloat nrm = 0;
-            for (int4 j = 0; j < rm->columns; j++) {
-                phloat x = rm->array->data[i * rm->columns + j];
-                if (x >= 0)
-                    nrm += x;
-                else
-                    nrm -= x;
-            }
+            phloat nrm = sum_abs_phloat(rm->array->data + i * rm->columns, rm->columns);
             if (p_isinf(nrm)) {
                 if (flags.f.range_error_ignore)
                     max = POS_HUGE_PHLOAT;
@@ -649,10 +647,8 @@ int docmd_rsum(arg_struct *arg) {
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (int4 i = 0; i < rm->rows; i++) {
-            phloat sum = 0;
+            phloat sum = sum_phloat(rm->array->data + i * rm->columns, rm->columns, 1);
             int inf;
-            for (int4 j = 0; j < rm->columns; j++)
-                sum += rm->array->data[i * rm->columns + j];
             if ((inf = p_isinf(sum)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -668,17 +664,15 @@ int docmd_rsum(arg_struct *arg) {
     } else if (stack[sp]->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm = (vartype_complexmatrix *) stack[sp];
         vartype_complexmatrix *res;
-        int4 i, j;
+        int4 i;
         res = (vartype_complexmatrix *) new_complexmatrix(cm->rows, 1);
         if (res == NULL)
             return ERR_INSUFFICIENT_MEMORY;
         for (i = 0; i < cm->rows; i++) {
-            phloat sum_re = 0, sum_im = 0;
+            const phloat *row = cm->array->data + 2 * i * cm->columns;
+            phloat sum_re = sum_phloat(row, cm->columns, 2);
+            phloat sum_im = sum_phloat(row + 1, cm->columns, 2);
             int inf;
-            for (j = 0; j < cm->columns; j++) {
-                sum_re += cm->array->data[2 * (i * cm->columns + j)];
-                sum_im += cm->array->data[2 * (i * cm->columns + j) + 1];
-            }
             if ((inf = p_isinf(sum_re)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -834,10 +828,7 @@ int docmd_stoel(arg_struct *arg) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
-                free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
-            rm->array->data[n] = ((vartype_real *) stack[sp])->x;
+            put_matrix_real(rm, n, ((vartype_real *) stack[sp])->x);
             return ERR_NONE;
         } else if (stack[sp]->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) stack[sp];
@@ -869,6 +860,7 @@ int docmd_stoel(arg_struct *arg) {
         vartype *v = dup_vartype(stack[sp]);
         if (v == NULL)
             return ERR_INSUFFICIENT_MEMORY;
+        invalidate_list_index(list->array);
         free_vartype(list->array->data[matedit_i]);
         list->array->data[matedit_i] = v;
         return ERR_NONE;
@@ -969,33 +961,36 @@ int docmd_tanh(arg_struct *arg) {
     return err;
 }
 
+/* Block size for transposing large matrices; working on square tiles keeps
+ * both the reads and the writes within a limited number of cache lines.
+ */
+#define TRANS_BLOCK 32
+
 int docmd_trans(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
+        int4 i0, j0, i, j;
         dst = (vartype_realmatrix *) new_realmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = i * columns + j;
-                int4 n2 = j * rows + i;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                if (dst->array->is_string[n2] == 2) {
-                    int4 *sp = *(int4 **) &src->array->data[n1];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_vartype((vartype *) dst);
-                        return ERR_INSUFFICIENT_MEMORY;
+        share_matrix_strings(dst->array, src->array);
+        dst->array->string_count = src->array->string_count;
+        for (i0 = 0; i0 < rows; i0 += TRANS_BLOCK) {
+            int4 i1 = i0 + TRANS_BLOCK < rows ? i0 + TRANS_BLOCK : rows;
+            for (j0 = 0; j0 < columns; j0 += TRANS_BLOCK) {
+                int4 j1 = j0 + TRANS_BLOCK < columns ? j0 + TRANS_BLOCK : columns;
+                for (i = i0; i < i1; i++)
+                    for (j = j0; j < j1; j++) {
+                        int4 n1 = i * columns + j;
+                        int4 n2 = j * rows + i;
+                        dst->array->is_string[n2] = src->array->is_string[n1];
+                        dst->array->data[n2] = src->array->data[n1];
                     }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &dst->array->data[n2] = dp;
-                } else
-                    dst->array->data[n2] = src->array->data[n1];
             }
+        }
         unary_result((vartype *) dst);
         return ERR_NONE;
     } else {
@@ -1003,17 +998,23 @@ int docmd_trans(arg_struct *arg) {
         vartype_complexmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
+        int4 i0, j0, i, j;
         dst = (vartype_complexmatrix *) new_complexmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = 2 * (i * columns + j);
-                int4 n2 = 2 * (j * rows + i);
-                dst->array->data[n2] = src->array->data[n1];
-                dst->array->data[n2 + 1] = src->array->data[n1 + 1];
+        for (i0 = 0; i0 < rows; i0 += TRANS_BLOCK) {
+            int4 i1 = i0 + TRANS_BLOCK < rows ? i0 + TRANS_BLOCK : rows;
+            for (j0 = 0; j0 < columns; j0 += TRANS_BLOCK) {
+                int4 j1 = j0 + TRANS_BLOCK < columns ? j0 + TRANS_BLOCK : columns;
+                for (i = i0; i < i1; i++)
+                    for (j = j0; j < j1; j++) {
+                        int4 n1 = 2 * (i * columns + j);
+                        int4 n2 = 2 * (j * rows + i);
+                        dst->array->data[n2] = src->array->data[n1];
+                        dst->array->data[n2 + 1] = src->array->data[n1 + 1];
+                    }
             }
+        }
         unary_result((vartype *) dst);
         return ERR_NONE;
     }
@@ -1335,10 +1336,7 @@ static int matedit_move(int direction) {
         if (!changed) {
             /* There's nothing to store, so leave cell unchanged */
         } else if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[old_n] == 2)
-                free(*(void **) &rm->array->data[old_n]);
-            rm->array->is_string[old_n] = 0;
-            rm->array->data[old_n] = ((vartype_real *) stack[sp])->x;
+            put_matrix_real(rm, old_n, ((vartype_real *) stack[sp])->x);
         } else {
             vartype_string *s = (vartype_string *) stack[sp];
             if (!put_matrix_string(rm, old_n, s->txt(), s->length)) {
@@ -102,9 +102,10 @@ static int get_summation() {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
-    for (i = first; i < last; i++)
-        if (r->array->is_string[i] != 0)
-            return ERR_ALPHA_DATA_IS_INVALID;
+    if (contains_strings(r))
+        for (i = first; i < last; i++)
+            if (r->array->is_string[i] != 0)
+                return ERR_ALPHA_DATA_IS_INVALID;
     sigmaregs = r->array->data + first;
     sum.x = sigmaregs[0];
     sum.x2 = sigmaregs[1];
@@ -2044,14 +2045,13 @@ static phloat sigma_helper_2(phloat *sigmaregs,
     return sigmaregs[5];
 }
 
-static int sigma_helper_1(int weight) {
+static int get_sigma_regs(phloat **sigmaregs) {
     /* Check if summation registers are OK */
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
     int4 size, i;
     vartype *regs = recall_var("REGS", 4);
     vartype_realmatrix *r;
-    phloat *sigmaregs;
     if (regs == NULL)
         return ERR_SIZE_ERROR;
     if (regs->type != TYPE_REALMATRIX)
@@ -2060,10 +2060,19 @@ static int sigma_helper_1(int weight) {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
-    for (i = first; i < last; i++)
-        if (r->array->is_string[i] != 0)
-            return ERR_ALPHA_DATA_IS_INVALID;
-    sigmaregs = r->array->data + first;
+    if (contains_strings(r))
+        for (i = first; i < last; i++)
+            if (r->array->is_string[i] != 0)
+                return ERR_ALPHA_DATA_IS_INVALID;
+    *sigmaregs = r->array->data + first;
+    return ERR_NONE;
+}
+
+static int sigma_helper_1(int weight) {
+    phloat *sigmaregs;
+    int err = get_sigma_regs(&sigmaregs);
+    if (err != ERR_NONE)
+        return err;
 
     /* All summation registers present, real-valued, non-string. */
     if (stack[sp]->type == TYPE_REALMATRIX) {
@@ -2072,9 +2081,8 @@ static int sigma_helper_1(int weight) {
         int4 i;
         if (rm->columns != 2)
             return ERR_DIMENSION_ERROR;
-        for (i = 0; i < rm->rows * 2; i++)
-            if (rm->array->is_string[i] != 0)
-                return ERR_ALPHA_DATA_IS_INVALID;
+        if (contains_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
         x = (vartype_real *) new_real(0);
         if (x == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -2112,6 +2120,20 @@ static int sigma_helper_1(int weight) {
     }
 }
 
+/* Adds n (x, y) pairs, stored as x0, y0, x1, y1, ..., to the summation
+ * registers, with the same result as n consecutive Σ+ operations, but
+ * without going through the stack. Used by core_import_sigma().
+ */
+int sigma_add_pairs(const phloat *xy, int4 n) {
+    phloat *sigmaregs;
+    int err = get_sigma_regs(&sigmaregs);
+    if (err != ERR_NONE)
+        return err;
+    for (int4 i = 0; i < n; i++)
+        sigma_helper_2(sigmaregs, xy[i * 2], xy[i * 2 + 1], 1);
+    return ERR_NONE;
+}
+
 int docmd_sigmaadd(arg_struct *arg) {
     int err = sigma_helper_1(1);
     if (err == ERR_NONE)
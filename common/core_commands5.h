@@ -115,5 +115,6 @@ int docmd_to_dec(arg_struct *arg);
 int docmd_to_oct(arg_struct *arg);
 int docmd_sigmaadd(arg_struct *arg);
 int docmd_sigmasub(arg_struct *arg);
+int sigma_add_pairs(const phloat *xy, int4 n);
 
 #endif
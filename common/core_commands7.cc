@@ -1160,10 +1160,7 @@ int docmd_putmi(arg_struct *arg) {
     if (v->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) v;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
-                free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
-            rm->array->data[n] = ((vartype_real *) stack[sp])->x;
+            put_matrix_real(rm, n, ((vartype_real *) stack[sp])->x);
         } else if (stack[sp]->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) stack[sp];
             if (!put_matrix_string(rm, n, s->txt(), s->length))
@@ -1726,6 +1723,39 @@ static int concat(bool extend) {
             len = reg_alpha_length;
         }
         vartype_string *s = (vartype_string *) stack[sp - 1];
+        if (s->length > SSLENV && len <= 2147483647 - s->length) {
+            // Y is consumed, so if it is a long string, we can extend its
+            // buffer in place, rather than copying it. This does what
+            // binary_result() does, but in an order that leaves Y intact
+            // if we run out of memory.
+            vartype *t = NULL;
+            bool ok = reserve_string(s, s->length + len);
+            if (ok && !flags.f.big_stack) {
+                t = dup_vartype(stack[REG_T]);
+                ok = t != NULL;
+            }
+            if (ok) {
+                memcpy(s->t.ptr + s->length, text, len);
+                s->length += len;
+            }
+            if (text == reg_alpha) {
+                memcpy(reg_alpha, buf, templen);
+                reg_alpha_length = templen;
+            }
+            if (!ok)
+                return ERR_INSUFFICIENT_MEMORY;
+            free_vartype(lastx);
+            lastx = stack[sp];
+            if (flags.f.big_stack) {
+                sp--;
+            } else {
+                stack[REG_Y] = stack[REG_Z];
+                stack[REG_Z] = t;
+            }
+            stack[sp] = (vartype *) s;
+            print_trace();
+            return ERR_NONE;
+        }
         vartype *v = new_string(NULL, s->length + len);
         if (v != NULL) {
             vartype_string *s2 = (vartype_string *) v;
@@ -2098,13 +2128,7 @@ int docmd_pos(arg_struct *arg) {
         if (startpos == -2)
             return ERR_INVALID_DATA;
         vartype_list *list = (vartype_list *) stack[list_sp];
-        pos = -1;
-        for (int4 i = startpos; i < list->size; i++) {
-            if (vartype_equals(list->array->data[i], stack[sp])) {
-                pos = i;
-                break;
-            }
-        }
+        pos = find_list_item(list, stack[sp], startpos);
     } else {
         return ERR_INVALID_TYPE;
     }
@@ -2294,6 +2318,205 @@ int docmd_from_list(arg_struct *arg) {
     return ERR_NONE;
 }
 
+/* SORT, SORTD, ORDER: sorting lists, and real matrices by row.
+ * Reals sort before strings; reals are compared numerically, strings by
+ * character code, with a prefix sorting before a longer string. Matrix rows
+ * are compared element by element, starting with the first column, so the
+ * first column is the sort key, the second breaks ties, and so on. Lists
+ * may only contain reals and strings.
+ * The sort is a bottom-up merge sort on an array of indices, so it takes
+ * O(n log n) comparisons, and it is stable in both directions: equal
+ * elements keep their original relative order.
+ */
+
+static int compare_sort_strings(const char *t1, int4 len1, const char *t2, int4 len2) {
+    int c = memcmp(t1, t2, len1 < len2 ? len1 : len2);
+    if (c != 0)
+        return c;
+    return len1 < len2 ? -1 : len1 > len2 ? 1 : 0;
+}
+
+static int compare_list_items(const void *ctx, int4 a, int4 b) {
+    vartype **items = (vartype **) ctx;
+    vartype *v1 = items[a];
+    vartype *v2 = items[b];
+    if (v1->type != v2->type)
+        return v1->type == TYPE_REAL ? -1 : 1;
+    if (v1->type == TYPE_REAL) {
+        phloat x1 = ((vartype_real *) v1)->x;
+        phloat x2 = ((vartype_real *) v2)->x;
+        return x1 < x2 ? -1 : x1 > x2 ? 1 : 0;
+    }
+    vartype_string *s1 = (vartype_string *) v1;
+    vartype_string *s2 = (vartype_string *) v2;
+    return compare_sort_strings(s1->txt(), s1->length, s2->txt(), s2->length);
+}
+
+static int compare_matrix_rows(const void *ctx, int4 a, int4 b) {
+    const vartype_realmatrix *rm = (const vartype_realmatrix *) ctx;
+    int4 n1 = a * rm->columns;
+    int4 n2 = b * rm->columns;
+    for (int4 j = 0; j < rm->columns; j++, n1++, n2++) {
+        bool s1 = rm->array->is_string[n1] != 0;
+        bool s2 = rm->array->is_string[n2] != 0;
+        int c;
+        if (s1 != s2)
+            return s1 ? 1 : -1;
+        if (s1) {
+            const char *t1, *t2;
+            int4 len1, len2;
+            get_matrix_string(rm, n1, &t1, &len1);
+            get_matrix_string(rm, n2, &t2, &len2);
+            c = compare_sort_strings(t1, len1, t2, len2);
+        } else {
+            phloat x1 = rm->array->data[n1];
+            phloat x2 = rm->array->data[n2];
+            c = x1 < x2 ? -1 : x1 > x2 ? 1 : 0;
+        }
+        if (c != 0)
+            return c;
+    }
+    return 0;
+}
+
+/* Sorts 'perm', which must contain 0 .. n - 1 on entry, by the keys the
+ * indices refer to. Returns false if the scratch buffer could not be
+ * allocated.
+ */
+static bool sort_indices(int4 *perm, int4 n, int (*cmp)(const void *, int4, int4), const void *ctx, bool descending) {
+    if (n < 2)
+        return true;
+    int4 *tmp = (int4 *) malloc(n * sizeof(int4));
+    if (tmp == NULL)
+        return false;
+    int4 *src = perm;
+    int4 *dst = tmp;
+    for (int4 width = 1; width < n; width *= 2) {
+        for (int4 lo = 0; lo < n; lo += 2 * width) {
+            int4 mid = lo + width < n ? lo + width : n;
+            int4 hi = mid + width < n ? mid + width : n;
+            int4 i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                // Only take from the right run if it is strictly
+                // first, to keep the sort stable
+                int c = cmp(ctx, src[j], src[i]);
+                if (descending ? c > 0 : c < 0)
+                    dst[k++] = src[j++];
+                else
+                    dst[k++] = src[i++];
+            }
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
+        int4 *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != perm)
+        memcpy(perm, src, n * sizeof(int4));
+    free(tmp);
+    return true;
+}
+
+static int sort_helper(bool descending, bool order) {
+    int4 n;
+    int (*cmp)(const void *, int4, int4);
+    const void *ctx;
+    if (stack[sp]->type == TYPE_LIST) {
+        vartype_list *list = (vartype_list *) stack[sp];
+        n = list->size;
+        for (int4 i = 0; i < n; i++) {
+            int type = list->array->data[i]->type;
+            if (type != TYPE_REAL && type != TYPE_STRING)
+                return ERR_INVALID_TYPE;
+        }
+        cmp = compare_list_items;
+        ctx = list->array->data;
+    } else {
+        vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
+        n = rm->rows;
+        cmp = compare_matrix_rows;
+        ctx = rm;
+    }
+
+    int4 *perm = (int4 *) malloc((n == 0 ? 1 : n) * sizeof(int4));
+    if (perm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    for (int4 i = 0; i < n; i++)
+        perm[i] = i;
+    if (!sort_indices(perm, n, cmp, ctx, descending)) {
+        free(perm);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    vartype *v;
+    if (order) {
+        v = new_list(n);
+        if (v == NULL)
+            goto nomem;
+        vartype_list *list = (vartype_list *) v;
+        for (int4 i = 0; i < n; i++) {
+            vartype *t = new_real(perm[i] + 1);
+            if (t == NULL) {
+                free_vartype(v);
+                goto nomem;
+            }
+            list->array->data[i] = t;
+        }
+    } else if (stack[sp]->type == TYPE_LIST) {
+        vartype_list *src = (vartype_list *) stack[sp];
+        v = new_list(n);
+        if (v == NULL)
+            goto nomem;
+        vartype_list *dst = (vartype_list *) v;
+        for (int4 i = 0; i < n; i++) {
+            vartype *t = dup_vartype(src->array->data[perm[i]]);
+            if (t == NULL) {
+                free_vartype(v);
+                goto nomem;
+            }
+            dst->array->data[i] = t;
+        }
+    } else {
+        // The sorted matrix shares the string arena with the original,
+        // so long strings are moved by pointer, like numbers.
+        vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
+        int4 columns = src->columns;
+        v = new_realmatrix(n, columns);
+        if (v == NULL)
+            goto nomem;
+        vartype_realmatrix *dst = (vartype_realmatrix *) v;
+        share_matrix_strings(dst->array, src->array);
+        for (int4 i = 0; i < n; i++) {
+            int4 s = perm[i] * columns;
+            memcpy(dst->array->is_string + i * columns, src->array->is_string + s, columns);
+            memcpy((void *) (dst->array->data + i * columns), (const void *) (src->array->data + s), columns * sizeof(phloat));
+        }
+        dst->array->string_count = src->array->string_count;
+    }
+    free(perm);
+    unary_result(v);
+    return ERR_NONE;
+
+    nomem:
+    free(perm);
+    return ERR_INSUFFICIENT_MEMORY;
+}
+
+int docmd_sort(arg_struct *arg) {
+    return sort_helper(false, false);
+}
+
+int docmd_sortd(arg_struct *arg) {
+    return sort_helper(true, false);
+}
+
+int docmd_order(arg_struct *arg) {
+    return sort_helper(false, true);
+}
+
 int docmd_width(arg_struct *arg) {
     vartype *v = new_real(131);
     if (v == NULL)
@@ -126,6 +126,9 @@ int docmd_list_t(arg_struct *arg);
 int docmd_newlist(arg_struct *arg);
 int docmd_to_list(arg_struct *arg);
 int docmd_from_list(arg_struct *arg);
+int docmd_sort(arg_struct *arg);
+int docmd_sortd(arg_struct *arg);
+int docmd_order(arg_struct *arg);
 
 int docmd_width(arg_struct *arg);
 int docmd_height(arg_struct *arg);
@@ -860,25 +860,46 @@ static void mark_dirty(int top, int left, int bottom, int right) {
     }
 }
 
+/* bigchars[] is stored column by column, but display[] is laid out row by
+ * row, so draw_char() uses this transposed copy, which lets it write each
+ * row of a glyph with one or two byte operations. Built on first use.
+ */
+static unsigned char bigchar_rows[138][8];
+static bool bigchar_rows_ready = false;
+
+static void init_bigchar_rows() {
+    for (int c = 0; c < 138; c++)
+        for (int v = 0; v < 8; v++) {
+            unsigned char row = 0;
+            for (int h = 0; h < 5; h++)
+                if (bigchars[c][h] & (1 << v))
+                    row |= 1 << h;
+            bigchar_rows[c][v] = row;
+        }
+    bigchar_rows_ready = true;
+}
+
 void draw_char(int x, int y, char c) {
-    int X, Y, h, v;
+    int X, Y, v;
     unsigned char uc = (unsigned char) c;
     if (x < 0 || x >= 22 || y < 0 || y >= 2)
         return;
     if (undefined_char(uc) || uc == 138)
         uc -= 128;
+    if (!bigchar_rows_ready)
+        init_bigchar_rows();
     X = x * 6;
     Y = y * 8;
+    /* A glyph is 5 pixels wide, so each row touches at most two bytes */
+    int shift = X & 7;
+    int mask = 31 << shift;
+    char *p = display + Y * 17 + (X >> 3);
     for (v = 0; v < 8; v++) {
-        int YY = Y + v;
-        for (h = 0; h < 5; h++) {
-            int XX = X + h;
-            char mask = 1 << (XX & 7);
-            if (bigchars[uc][h] & (1 << v))
-                display[YY * 17 + (XX >> 3)] |= mask;
-            else
-                display[YY * 17 + (XX >> 3)] &= ~mask;
-        }
+        int bits = bigchar_rows[uc][v] << shift;
+        p[0] = (char) ((p[0] & ~mask) | bits);
+        if (mask > 255)
+            p[1] = (char) ((p[1] & ~(mask >> 8)) | (bits >> 8));
+        p += 17;
     }
     mark_dirty(Y, X, Y + 8, X + 5);
 }
@@ -898,13 +919,32 @@ void draw_string(int x, int y, const char *s, int length) {
 }
 
 static void fill_rect(int x, int y, int width, int height, int color) {
-    int h, v;
-    for (v = y; v < y + height; v++)
-        for (h = x; h < x + width; h++)
-            if (color)
-                display[v * 17 + (h >> 3)] |= 1 << (h & 7);
-            else
-                display[v * 17 + (h >> 3)] &= ~(1 << (h & 7));
+    if (width > 0) {
+        /* Partial bytes at either end, whole bytes in between */
+        int right = x + width - 1;
+        int b0 = x >> 3;
+        int b1 = right >> 3;
+        int m0 = (0xff << (x & 7)) & 0xff;
+        int m1 = 0xff >> (7 - (right & 7));
+        if (b0 == b1)
+            m0 &= m1;
+        for (int v = y; v < y + height; v++) {
+            char *row = display + v * 17;
+            if (color) {
+                row[b0] |= m0;
+                if (b1 > b0) {
+                    memset(row + b0 + 1, 0xff, b1 - b0 - 1);
+                    row[b1] |= m1;
+                }
+            } else {
+                row[b0] &= ~m0;
+                if (b1 > b0) {
+                    memset(row + b0 + 1, 0, b1 - b0 - 1);
+                    row[b1] &= ~m1;
+                }
+            }
+        }
+    }
     mark_dirty(y, x, y + height, x + width);
 }
 
@@ -1248,6 +1288,79 @@ void xlabel2buf(char *buf, int buflen, int *bufptr) {
     }
 }
 
+/* display_x() and display_y() run on every redisplay, and a program that
+ * VIEWs or PSEs in a loop redisplays constantly, usually showing the same
+ * numbers over and over. Formatting a number is the expensive part, so we
+ * remember the last result for each row, along with everything that
+ * phloat2string() depends on.
+ */
+struct number_display_cache {
+    bool valid;
+    int type;
+    phloat re, im;
+    flags_struct flags;
+    int appmenu;
+    int wsize;
+    bool dec_int, bin_sep, oct_sep, dec_sep, hex_sep;
+    int buflen;
+    int len;
+    char buf[22];
+};
+
+static number_display_cache x_display_cache;
+static number_display_cache y_display_cache;
+
+static int cached_vartype2string(number_display_cache *c, const vartype *v,
+                                 char *buf, int buflen) {
+    if (v->type != TYPE_REAL && v->type != TYPE_COMPLEX)
+        return vartype2string(v, buf, buflen);
+    phloat re, im;
+    if (v->type == TYPE_REAL) {
+        re = ((vartype_real *) v)->x;
+        im = 0;
+    } else {
+        re = ((vartype_complex *) v)->re;
+        im = ((vartype_complex *) v)->im;
+    }
+    if (c->valid
+            && c->type == v->type
+            && c->buflen == buflen
+            && memcmp(&c->re, &re, sizeof(phloat)) == 0
+            && memcmp(&c->im, &im, sizeof(phloat)) == 0
+            && memcmp(&c->flags, &flags, sizeof(flags_struct)) == 0
+            && c->appmenu == mode_appmenu
+            && c->wsize == mode_wsize
+            && c->dec_int == mode_dec_int
+            && c->bin_sep == mode_bin_sep
+            && c->oct_sep == mode_oct_sep
+            && c->dec_sep == mode_dec_sep
+            && c->hex_sep == mode_hex_sep) {
+        memcpy(buf, c->buf, c->len < buflen ? c->len : buflen);
+        return c->len;
+    }
+    int len = vartype2string(v, buf, buflen);
+    if (buflen > (int) sizeof(c->buf)) {
+        c->valid = false;
+        return len;
+    }
+    c->valid = true;
+    c->type = v->type;
+    c->re = re;
+    c->im = im;
+    c->flags = flags;
+    c->appmenu = mode_appmenu;
+    c->wsize = mode_wsize;
+    c->dec_int = mode_dec_int;
+    c->bin_sep = mode_bin_sep;
+    c->oct_sep = mode_oct_sep;
+    c->dec_sep = mode_dec_sep;
+    c->hex_sep = mode_hex_sep;
+    c->buflen = buflen;
+    c->len = len;
+    memcpy(c->buf, buf, len < buflen ? len : buflen);
+    return len;
+}
+
 void display_x(int row) {
     char buf[22];
     int bufptr = 0;
@@ -1256,7 +1369,7 @@ void display_x(int row) {
     xlabel2buf(buf, 22, &bufptr);
     vartype *x = sp >= 0 ? stack[sp] : NULL;
     if (x != NULL)
-        bufptr += vartype2string(x, buf + bufptr, 22 - bufptr);
+        bufptr += cached_vartype2string(&x_display_cache, x, buf + bufptr, 22 - bufptr);
     draw_string(0, row, buf, bufptr);
 }
 
@@ -1270,7 +1383,7 @@ void display_y(int row) {
     else
         draw_string(0, row, "\201\200", 2);
     if (y != NULL) {
-        len = vartype2string(y, buf, 20);
+        len = cached_vartype2string(&y_display_cache, y, buf, 20);
         if (len > 20) {
             draw_string(2, row, buf, 19);
             draw_char(21, row, 26);
@@ -1618,8 +1731,8 @@ static int ext_prgm_cat[] = {
 static int ext_str_cat[] = {
     CMD_APPEND,    CMD_C_TO_N, CMD_EXTEND, CMD_HEAD,    CMD_LENGTH, CMD_TO_LIST,
     CMD_FROM_LIST, CMD_LIST_T, CMD_LXASTO, CMD_NEWLIST, CMD_N_TO_C, CMD_N_TO_S,
-    CMD_NN_TO_S,   CMD_POS,    CMD_REV,    CMD_SUBSTR,  CMD_S_TO_N, CMD_XASTO,
-    CMD_XSTR,      CMD_XVIEW,  CMD_NULL,   CMD_NULL,    CMD_NULL,   CMD_NULL
+    CMD_NN_TO_S,   CMD_ORDER,  CMD_POS,    CMD_REV,     CMD_SORT,   CMD_SORTD,
+    CMD_SUBSTR,    CMD_S_TO_N, CMD_XASTO,  CMD_XSTR,    CMD_XVIEW,  CMD_NULL
 };
 
 static int ext_stk_cat[] = {
@@ -1676,6 +1789,104 @@ static int ext_x_cmp_cat[] = {
     CMD_X_EQ_NN, CMD_X_NE_NN, CMD_X_LT_NN, CMD_X_GT_NN, CMD_X_LE_NN, CMD_X_GE_NN
 };
 
+/* The items of the catalog section that was drawn last, as indexes into
+ * labels[] or vars[], in display order. Building this takes a pass over
+ * all labels or variables; after that, paging through the section only
+ * needs to look at the six items on the page. It is invalidated whenever
+ * the label table or the variables change.
+ */
+static int *catalog_index = NULL;
+static int catalog_index_capacity = 0;
+static int catalog_index_count = 0;
+static int catalog_index_sect = -1;
+
+void invalidate_catalog_index() {
+    catalog_index_sect = -1;
+}
+
+static void build_catalog_index(int catsect) {
+    bool pgm = catsect == CATSECT_PGM
+            || catsect == CATSECT_PGM_ONLY
+            || catsect == CATSECT_PGM_SOLVE
+            || catsect == CATSECT_PGM_INTEG
+            || catsect == CATSECT_PGM_MENU;
+    int n = pgm ? labels_count : vars_count;
+    catalog_index_count = 0;
+    catalog_index_sect = catsect;
+    if (n > catalog_index_capacity) {
+        int *newindex = (int *) realloc(catalog_index, n * sizeof(int));
+        if (newindex == NULL) {
+            // The section will look empty until the next rebuild
+            catalog_index_sect = -1;
+            return;
+        }
+        catalog_index = newindex;
+        catalog_index_capacity = n;
+    }
+
+    if (pgm) {
+        for (int i = labels_count - 1; i >= 0; i--) {
+            bool show_this_label;
+            if (catsect == CATSECT_PGM || catsect == CATSECT_PGM_ONLY) {
+                show_this_label = labels[i].length > 0 || i == 0
+                                    || labels[i - 1].prgm != labels[i].prgm;
+            } else {
+                show_this_label = label_has_mvar(i);
+            }
+            if (show_this_label)
+                catalog_index[catalog_index_count++] = i;
+        }
+        return;
+    }
+
+    int show_real = 1;
+    int show_str = 1;
+    int show_cpx = 1;
+    int show_mat = 1;
+    int show_list = 1;
+
+    switch (catsect) {
+        case CATSECT_REAL:
+        case CATSECT_REAL_ONLY:
+            show_cpx = show_mat = show_list = 0; break;
+        case CATSECT_CPX:
+            show_real = show_str = show_mat = show_list = 0; break;
+        case CATSECT_MAT:
+        case CATSECT_MAT_ONLY:
+            show_real = show_str = show_cpx = show_list = 0; break;
+        case CATSECT_MAT_LIST:
+        case CATSECT_MAT_LIST_ONLY:
+            show_real = show_str = show_cpx = 0; break;
+        case CATSECT_LIST_STR_ONLY:
+            show_real = show_cpx = show_mat = 0; break;
+        case CATSECT_LIST:
+        case CATSECT_LIST_ONLY:
+            show_real = show_str = show_cpx = show_mat = 0; break;
+    }
+
+    for (int i = vars_count - 1; i >= 0; i--) {
+        if ((vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) != 0)
+            continue;
+        int type = vars[i].value->type;
+        switch (type) {
+            case TYPE_REAL:
+                if (show_real) break; else continue;
+            case TYPE_STRING:
+                if (show_str) break; else continue;
+            case TYPE_COMPLEX:
+                if (show_cpx) break; else continue;
+            case TYPE_REALMATRIX:
+            case TYPE_COMPLEXMATRIX:
+                if (show_mat) break; else continue;
+            case TYPE_LIST:
+                if (show_list) break; else continue;
+            default:
+                continue;
+        }
+        catalog_index[catalog_index_count++] = i;
+    }
+}
+
 static void draw_catalog() {
     int catsect = get_cat_section();
     int catindex = get_cat_index();
@@ -1713,49 +1924,24 @@ static void draw_catalog() {
             || catsect == CATSECT_PGM_INTEG
             || catsect == CATSECT_PGM_MENU) {
         /* Show menu of alpha labels */
-        int lcount = 0;
-        int i, j, k = -1;
-        if (catsect == CATSECT_PGM || catsect == CATSECT_PGM_ONLY) {
-            int lastprgm = -1;
-            for (i = 0; i < labels_count; i++) {
-                if (labels[i].length > 0 || labels[i].prgm != lastprgm)
-                    lcount++;
-                lastprgm = labels[i].prgm;
-            }
-        } else /* CATSECT_PGM_SOLVE, CATSECT_PGM_INTEG, CATSECT_PGM_MENU */ {
-            for (i = 0; i < labels_count; i++)
-                if (label_has_mvar(i))
-                    lcount++;
-        }
-        catalogmenu_rows[catindex] = (lcount + 5) / 6;
+        int k = -1;
+        if (catalog_index_sect != catsect)
+            build_catalog_index(catsect);
+        catalogmenu_rows[catindex] = (catalog_index_count + 5) / 6;
         if (catalogmenu_row[catindex] >= catalogmenu_rows[catindex])
             catalogmenu_row[catindex] = catalogmenu_rows[catindex] - 1;
-        j = -1;
-        for (i = labels_count - 1; i >= 0; i--) {
-            bool show_this_label;
-            if (catsect == CATSECT_PGM || catsect == CATSECT_PGM_ONLY) {
-                show_this_label = labels[i].length > 0 || i == 0
-                                    || labels[i - 1].prgm != labels[i].prgm;
-            } else {
-                show_this_label = label_has_mvar(i);
-            }
-            if (show_this_label) {
-                j++;
-                if (j / 6 == catalogmenu_row[catindex]) {
-                    int len = labels[i].length;
-                    k = j % 6;
-                    if (len == 0) {
-                        if (i == labels_count - 1)
-                            draw_key(k, 0, 0, ".END.", 5);
-                        else
-                            draw_key(k, 0, 0, "END", 3);
-                    } else
-                        draw_key(k, 0, 0, labels[i].name, labels[i].length);
-                    catalogmenu_item[catindex][k] = i;
-                    if (k == 5)
-                        break;
-                }
-            }
+        for (int j = catalogmenu_row[catindex] * 6; j >= 0 && j < catalog_index_count && k < 5; j++) {
+            int i = catalog_index[j];
+            int len = labels[i].length;
+            k = j % 6;
+            if (len == 0) {
+                if (i == labels_count - 1)
+                    draw_key(k, 0, 0, ".END.", 5);
+                else
+                    draw_key(k, 0, 0, "END", 3);
+            } else
+                draw_key(k, 0, 0, labels[i].name, labels[i].length);
+            catalogmenu_item[catindex][k] = i;
         }
         while (k < 5) {
             draw_key(++k, 0, 0, "", 0);
@@ -1798,57 +1984,10 @@ static void draw_catalog() {
         mode_updown = subcat_rows > 1;
         shell_annunciators(mode_updown ? 1 : 0, -1, -1, -1, -1, -1);
     } else {
-        int vcount = 0;
-        int i, j, k = -1;
-        int show_real = 1;
-        int show_str = 1;
-        int show_cpx = 1;
-        int show_mat = 1;
-        int show_list = 1;
-
-        switch (catsect) {
-            case CATSECT_REAL:
-            case CATSECT_REAL_ONLY:
-                show_cpx = show_mat = show_list = 0; break;
-            case CATSECT_CPX:
-                show_real = show_str = show_mat = show_list = 0; break;
-            case CATSECT_MAT:
-            case CATSECT_MAT_ONLY:
-                show_real = show_str = show_cpx = show_list = 0; break;
-            case CATSECT_MAT_LIST:
-            case CATSECT_MAT_LIST_ONLY:
-                show_real = show_str = show_cpx = 0; break;
-            case CATSECT_LIST_STR_ONLY:
-                show_real = show_cpx = show_mat = 0; break;
-            case CATSECT_LIST:
-            case CATSECT_LIST_ONLY:
-                show_real = show_str = show_cpx = show_mat = 0; break;
-        }
-
-        for (i = 0; i < vars_count; i++) {
-            int type = vars[i].value->type;
-            if ((vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) != 0)
-                continue;
-            switch (type) {
-                case TYPE_REAL:
-                    if (show_real) vcount++;
-                    break;
-                case TYPE_STRING:
-                    if (show_str) vcount++;
-                    break;
-                case TYPE_COMPLEX:
-                    if (show_cpx) vcount++;
-                    break;
-                case TYPE_REALMATRIX:
-                case TYPE_COMPLEXMATRIX:
-                    if (show_mat) vcount++;
-                    break;
-                case TYPE_LIST:
-                    if (show_list) vcount++;
-                    break;
-            }
-        }
-        if (vcount == 0) {
+        int k = -1;
+        if (catalog_index_sect != catsect)
+            build_catalog_index(catsect);
+        if (catalog_index_count == 0) {
             /* We should only get here if the 'plainmenu' catalog is
              * in operation; the other catalogs only operate during
              * command entry mode, or are label catalogs -- so in those
@@ -1865,37 +2004,14 @@ static void draw_catalog() {
             goto draw_top;
         }
 
-        catalogmenu_rows[catindex] = (vcount + 5) / 6;
+        catalogmenu_rows[catindex] = (catalog_index_count + 5) / 6;
         if (catalogmenu_row[catindex] >= catalogmenu_rows[catindex])
             catalogmenu_row[catindex] = catalogmenu_rows[catindex] - 1;
-        j = -1;
-        for (i = vars_count - 1; i >= 0; i--) {
-            if ((vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) != 0)
-                continue;
-            int type = vars[i].value->type;
-            switch (type) {
-                case TYPE_REAL:
-                    if (show_real) break; else continue;
-                case TYPE_STRING:
-                    if (show_str) break; else continue;
-                case TYPE_COMPLEX:
-                    if (show_cpx) break; else continue;
-                case TYPE_REALMATRIX:
-                case TYPE_COMPLEXMATRIX:
-                    if (show_mat) break; else continue;
-                case TYPE_LIST:
-                    if (show_list) break; else continue;
-                default:
-                    continue;
-            }
-            j++;
-            if (j / 6 == catalogmenu_row[catindex]) {
-                k = j % 6;
-                draw_key(k, 0, 0, vars[i].name, vars[i].length);
-                catalogmenu_item[catindex][k] = i;
-                if (k == 5)
-                    break;
-            }
+        for (int j = catalogmenu_row[catindex] * 6; j < catalog_index_count && k < 5; j++) {
+            int i = catalog_index[j];
+            k = j % 6;
+            draw_key(k, 0, 0, vars[i].name, vars[i].length);
+            catalogmenu_item[catindex][k] = i;
         }
         while (k < 5) {
             draw_key(++k, 0, 0, "", 0);
@@ -641,6 +641,8 @@ const char *virtual_flags =
 /* Variables */
 int vars_capacity = 0;
 int vars_count = 0;
+/* Number of entries in vars[] with level != -1 */
+int local_vars_count = 0;
 var_struct *vars = NULL;
 
 /* Programs */
@@ -822,9 +824,44 @@ bool no_keystrokes_yet;
 /* Private globals */
 /*******************/
 
+/* Saved state for FUNC and LNSTK/L4STK; see push_func_state(). A frame
+ * belongs to the return stack level that executed the FUNC or LNSTK/L4STK.
+ * In the state file, it is written as a private STK variable at that level,
+ * so the file format doesn't depend on this structure; see
+ * persist_func_frame().
+ * Frames are recycled, and each keeps the last stack array it saved as a
+ * spare, so FUNC doesn't have to allocate anything besides the copies of
+ * its parameters.
+ */
+struct func_frame {
+    // Mode: [0-4][0-4] for FUNC, or -1 for stand-alone LNSTK/L4STK;
+    // -2 if the state was lost in an upgrade from a version before 47
+    int n;
+    // Caller Big Stack, LNSTK/L4STK after FUNC, CSLD, F25, ERRNO
+    char state[5];
+    int lasterr_length;
+    char lasterr_text[22];
+    // Saved stack; NULL for stand-alone LNSTK/L4STK that didn't need it
+    vartype **stack;
+    int4 stack_size;
+    int4 stack_capacity;
+    // Saved LASTX (FUNC only)
+    vartype *lastx;
+    // Stack array kept for the next FUNC that uses this frame
+    vartype **spare;
+    int4 spare_capacity;
+    func_frame *next_free;
+};
+
+/* In the state file, the has_func bit in 'prgm' marks levels with a
+ * FUNC frame; at run time, that is what the 'func' pointer is for.
+ */
+#define RTN_HAS_FUNC 0x40000000
+
 struct rtn_stack_entry {
     int4 prgm;
     int4 pc;
+    func_frame *func;
     int4 get_prgm() {
         int4 p = prgm & 0x1fffffff;
         if ((p & 0x10000000) != 0)
@@ -843,15 +880,6 @@ struct rtn_stack_entry {
         else
             prgm &= 0x7fffffff;
     }
-    bool has_func() {
-        return (prgm & 0x40000000) != 0;
-    }
-    void set_has_func(bool state) {
-        if (state)
-            prgm |= 0x40000000;
-        else
-            prgm &= 0xbfffffff;
-    }
     bool is_csld() {
         return (prgm & 0x20000000) != 0;
     }
@@ -863,16 +891,169 @@ struct rtn_stack_entry {
     }
 };
 
+/* The maximum depth can be raised at build time; it must stay below 32768,
+ * since that is the range of var_struct.level. The stack itself grows
+ * geometrically, so deep recursion doesn't pay for many reallocs.
+ */
+#ifndef MAX_RTN_LEVEL
 #define MAX_RTN_LEVEL 1024
+#endif
 static int rtn_stack_capacity = 0;
 static rtn_stack_entry *rtn_stack = NULL;
 static int rtn_level = 0;
 static bool rtn_level_0_has_matrix_entry;
-static bool rtn_level_0_has_func_state;
+static func_frame *rtn_level_0_func = NULL;
+static func_frame *func_frame_pool = NULL;
 static int rtn_stop_level = -1;
 static bool rtn_solve_active = false;
 static bool rtn_integ_active = false;
 
+static func_frame *func_frame_at(int level) {
+    return level == 0 ? rtn_level_0_func : rtn_stack[level - 1].func;
+}
+
+static func_frame **func_frame_slot() {
+    return rtn_level == 0 ? &rtn_level_0_func : &rtn_stack[rtn_level - 1].func;
+}
+
+static func_frame *new_func_frame() {
+    func_frame *f = func_frame_pool;
+    if (f != NULL) {
+        func_frame_pool = f->next_free;
+    } else {
+        f = (func_frame *) malloc(sizeof(func_frame));
+        if (f == NULL)
+            return NULL;
+        f->spare = NULL;
+        f->spare_capacity = 0;
+    }
+    f->stack = NULL;
+    f->stack_size = 0;
+    f->stack_capacity = 0;
+    f->lastx = NULL;
+    f->lasterr_length = 0;
+    return f;
+}
+
+/* Frees the saved stack and LASTX, and returns the frame to the pool. The
+ * stack array becomes the frame's spare, unless it is large; big stacks can
+ * grow without limit, and the spare would be kept around indefinitely.
+ */
+static void free_func_frame(func_frame *f) {
+    if (f->stack != NULL) {
+        for (int4 i = 0; i < f->stack_size; i++)
+            free_vartype(f->stack[i]);
+        if (f->spare == NULL && f->stack_capacity <= 16) {
+            f->spare = f->stack;
+            f->spare_capacity = f->stack_capacity;
+        } else
+            free(f->stack);
+    }
+    free_vartype(f->lastx);
+    f->next_free = func_frame_pool;
+    func_frame_pool = f;
+}
+
+/* Frees all FUNC frames, including the pooled ones; for use when the
+ * return stack is being discarded wholesale.
+ */
+void clear_func_frames() {
+    for (int i = 0; i <= rtn_level; i++) {
+        func_frame **slot = i == 0 ? &rtn_level_0_func : &rtn_stack[i - 1].func;
+        if (*slot != NULL) {
+            free_func_frame(*slot);
+            *slot = NULL;
+        }
+    }
+    while (func_frame_pool != NULL) {
+        func_frame *f = func_frame_pool;
+        func_frame_pool = f->next_free;
+        free(f->spare);
+        free(f);
+    }
+}
+
+struct rtn_conv_entry {
+    int4 prgm;
+    int4 loc;
+    int index;
+};
+
+static int rtn_conv_compare(const void *a, const void *b) {
+    const rtn_conv_entry *x = (const rtn_conv_entry *) a;
+    const rtn_conv_entry *y = (const rtn_conv_entry *) b;
+    if (x->prgm != y->prgm)
+        return x->prgm < y->prgm ? -1 : 1;
+    if (x->loc != y->loc)
+        return x->loc < y->loc ? -1 : 1;
+    return 0;
+}
+
+/* Converts the return addresses of all RTN stack levels from pc to line
+ * numbers, or the other way around. loc[i] belongs to rtn_stack[i], and is
+ * converted in place; entries that don't refer to a program are left alone.
+ * Converting one at a time costs a walk through the program for each level,
+ * which adds up with deep recursion; instead, we sort the addresses and
+ * convert all the ones in each program in a single pass.
+ */
+static void convert_rtn_locations(int4 *loc, bool loc_is_pc) {
+    rtn_conv_entry *conv = (rtn_conv_entry *) malloc(rtn_level * sizeof(rtn_conv_entry));
+    if (conv == NULL) {
+        for (int i = 0; i < rtn_level; i++) {
+            int prgm = rtn_stack[i].get_prgm();
+            if (prgm >= 0)
+                loc[i] = loc_is_pc ? global_pc2line(prgm, loc[i])
+                                   : global_line2pc(prgm, loc[i]);
+        }
+        return;
+    }
+    int n = 0;
+    for (int i = 0; i < rtn_level; i++) {
+        int prgm = rtn_stack[i].get_prgm();
+        if (prgm < 0)
+            continue;
+        conv[n].prgm = prgm;
+        conv[n].loc = loc[i];
+        conv[n].index = i;
+        n++;
+    }
+    qsort(conv, n, sizeof(rtn_conv_entry), rtn_conv_compare);
+    int prgm = -1;
+    int4 pc = 0;
+    int4 line = 1;
+    for (int i = 0; i < n; i++) {
+        rtn_conv_entry *c = conv + i;
+        if (c->prgm != prgm) {
+            prgm = c->prgm;
+            pc = 0;
+            line = 1;
+        }
+        prgm_struct *p = prgms + prgm;
+        if (loc_is_pc) {
+            if (c->loc == -1) {
+                loc[c->index] = 0;
+                continue;
+            }
+            while (pc < c->loc && !p->is_end(pc)) {
+                pc += get_command_length(prgm, pc);
+                line++;
+            }
+            loc[c->index] = line;
+        } else {
+            if (c->loc == 0) {
+                loc[c->index] = -1;
+                continue;
+            }
+            while (line < c->loc && !p->is_end(pc)) {
+                pc += get_command_length(prgm, pc);
+                line++;
+            }
+            loc[c->index] = pc;
+        }
+    }
+    free(conv);
+}
+
 #ifdef IPHONE
 /* For iPhone, we disable OFF by default, to satisfy App Store
  * policy, but we allow users to enable it using a magic value
@@ -887,15 +1068,25 @@ struct matrix_persister {
     int4 columns;
 };
 
+/* Shared matrices and lists are written only once; array_list holds the ones
+ * written or read so far, and later references use their index in that list.
+ * While saving, array_hash maps array_list entries back to their indexes, so
+ * that finding previously written arrays doesn't require linear searches.
+ */
 static int array_count;
 static int array_list_capacity;
 static void **array_list;
+static int *array_hash;
+static int array_hash_capacity;
 
 
-static bool array_list_grow();
+static void array_list_init();
+static void array_list_cleanup();
+static bool array_list_add(void *array, bool hashed);
 static int array_list_search(void *array);
 static bool persist_vartype(vartype *v);
 static bool unpersist_vartype(vartype **v);
+static void labels_changed();
 static void update_label_table(int prgm, int4 pc, int inserted);
 static void invalidate_lclbls(int prgm_index, bool force);
 static int pc_line_convert(int4 loc, int loc_is_pc);
@@ -920,23 +1111,83 @@ void vartype_string::trim1() {
     }
 }
 
-static bool array_list_grow() {
-    if (array_count < array_list_capacity)
+static void array_list_init() {
+    array_count = 0;
+    array_list_capacity = 0;
+    array_list = NULL;
+    array_hash = NULL;
+    array_hash_capacity = 0;
+}
+
+static void array_list_cleanup() {
+    free(array_list);
+    free(array_hash);
+    array_list_init();
+}
+
+static int array_hash_code(void *array, int capacity) {
+    size_t h = (size_t) array;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return (int) (h & (capacity - 1));
+}
+
+static bool array_hash_grow() {
+    // Keep the load factor at or below 1/2
+    if (2 * (array_count + 1) <= array_hash_capacity)
         return true;
-    array_list_capacity += 10;
-    void **p = (void **) realloc(array_list,
-                                 array_list_capacity * sizeof(void *));
-    if (p == NULL)
+    int newcap = array_hash_capacity == 0 ? 64 : 2 * array_hash_capacity;
+    int *h = (int *) malloc(newcap * sizeof(int));
+    if (h == NULL)
         return false;
-    array_list = p;
+    for (int i = 0; i < newcap; i++)
+        h[i] = -1;
+    for (int i = 0; i < array_count; i++) {
+        int j = array_hash_code(array_list[i], newcap);
+        while (h[j] != -1)
+            j = (j + 1) & (newcap - 1);
+        h[j] = i;
+    }
+    free(array_hash);
+    array_hash = h;
+    array_hash_capacity = newcap;
+    return true;
+}
+
+static bool array_list_add(void *array, bool hashed) {
+    if (array_count == array_list_capacity) {
+        int newcap = array_list_capacity == 0 ? 16 : 2 * array_list_capacity;
+        void **p = (void **) realloc(array_list, newcap * sizeof(void *));
+        if (p == NULL)
+            return false;
+        array_list = p;
+        array_list_capacity = newcap;
+    }
+    if (hashed) {
+        if (!array_hash_grow())
+            return false;
+        int j = array_hash_code(array, array_hash_capacity);
+        while (array_hash[j] != -1)
+            j = (j + 1) & (array_hash_capacity - 1);
+        array_hash[j] = array_count;
+    }
+    array_list[array_count++] = array;
     return true;
 }
 
 static int array_list_search(void *array) {
-    for (int i = 0; i < array_count; i++)
-        if (array_list[i] == array)
-            return i;
-    return -1;
+    if (array_hash_capacity == 0)
+        return -1;
+    int j = array_hash_code(array, array_hash_capacity);
+    while (true) {
+        int n = array_hash[j];
+        if (n == -1)
+            return -1;
+        if (array_list[n] == array)
+            return n;
+        j = (j + 1) & (array_hash_capacity - 1);
+    }
 }
 
 static bool persist_vartype(vartype *v) {
@@ -968,9 +1219,8 @@ static bool persist_vartype(vartype *v) {
                 if (n == -1) {
                     // A negative row count signals a new shared matrix
                     rows = -rows;
-                    if (!array_list_grow())
+                    if (!array_list_add(rm->array, true))
                         return false;
-                    array_list[array_count++] = rm->array;
                 } else {
                     // A zero row count means this matrix shares its data
                     // with a previously written matrix
@@ -1012,9 +1262,8 @@ static bool persist_vartype(vartype *v) {
                 if (n == -1) {
                     // A negative row count signals a new shared matrix
                     rows = -rows;
-                    if (!array_list_grow())
+                    if (!array_list_add(cm->array, true))
                         return false;
-                    array_list[array_count++] = cm->array;
                 } else {
                     // A zero row count means this matrix shares its data
                     // with a previously written matrix
@@ -1043,9 +1292,8 @@ static bool persist_vartype(vartype *v) {
                 if (n == -1) {
                     // data_index == -2 indicates a new shared list
                     data_index = -2;
-                    if (!array_list_grow())
+                    if (!array_list_add(list->array, true))
                         return false;
-                    array_list[array_count++] = list->array;
                 } else {
                     // data_index >= 0 refers to a previously shared list
                     data_index = n;
@@ -1153,6 +1401,8 @@ static bool unpersist_vartype(vartype **v) {
                 return false;
             if (rows == 0) {
                 // Shared matrix
+                if (columns < 0 || columns >= array_count)
+                    return false;
                 vartype *m = dup_vartype((vartype *) array_list[columns]);
                 if (m == NULL)
                     return false;
@@ -1181,6 +1431,7 @@ static bool unpersist_vartype(vartype **v) {
                         break;
                 } else {
                     rm->array->is_string[i] = 1;
+                    rm->array->string_count++;
                     if (bug_mode == 0) {
                         if (ver < 34) {
                             // 6 bytes of text followed by length byte
@@ -1194,14 +1445,11 @@ static bool unpersist_vartype(vartype **v) {
                             if (!read_int4(&len))
                                 break;
                             if (len > SSLENM) {
-                                int4 *p = (int4 *) malloc(len + 4);
+                                int4 *p = new_matrix_string(rm->array, len);
                                 if (p == NULL)
                                     break;
-                                if (fread(p + 1, 1, len, gfile) != len) {
-                                    free(p);
+                                if (fread(p + 1, 1, len, gfile) != len)
                                     break;
-                                }
-                                *p = len;
                                 *(int4 **) &rm->array->data[i] = p;
                                 rm->array->is_string[i] = 2;
                             } else {
@@ -1251,11 +1499,10 @@ static bool unpersist_vartype(vartype **v) {
                 return false;
             }
             if (shared) {
-                if (!array_list_grow()) {
+                if (!array_list_add(rm, false)) {
                     free_vartype((vartype *) rm);
                     return false;
                 }
-                array_list[array_count++] = rm;
             }
             *v = (vartype *) rm;
             return true;
@@ -1266,6 +1513,8 @@ static bool unpersist_vartype(vartype **v) {
                 return false;
             if (rows == 0) {
                 // Shared matrix
+                if (columns < 0 || columns >= array_count)
+                    return false;
                 vartype *m = dup_vartype((vartype *) array_list[columns]);
                 if (m == NULL)
                     return false;
@@ -1288,11 +1537,10 @@ static bool unpersist_vartype(vartype **v) {
                 }
             }
             if (shared) {
-                if (!array_list_grow()) {
+                if (!array_list_add(cm, false)) {
                     free_vartype((vartype *) cm);
                     return false;
                 }
-                array_list[array_count++] = cm;
             }
             *v = (vartype *) cm;
             return true;
@@ -1304,6 +1552,8 @@ static bool unpersist_vartype(vartype **v) {
                 return false;
             if (data_index >= 0) {
                 // Shared list
+                if (data_index >= array_count)
+                    return false;
                 vartype *m = dup_vartype((vartype *) array_list[data_index]);
                 if (m == NULL)
                     return false;
@@ -1317,11 +1567,10 @@ static bool unpersist_vartype(vartype **v) {
             if (list == NULL)
                 return false;
             if (shared) {
-                if (!array_list_grow()) {
+                if (!array_list_add(list, false)) {
                     free_vartype((vartype *) list);
                     return false;
                 }
-                array_list[array_count++] = list;
             }
             for (int4 i = 0; i < size; i++) {
                 if (!unpersist_vartype(&list->array->data[i])) {
@@ -1337,11 +1586,150 @@ static bool unpersist_vartype(vartype **v) {
     }
 }
 
+/* Writes the FUNC frame at the given level, if there is one, as a private
+ * STK variable in the list layout described above push_func_state(). The
+ * list borrows the frame's saved stack and LASTX while it is being written.
+ */
+static bool persist_func_frame(int level) {
+    func_frame *f = func_frame_at(level);
+    if (f == NULL || f->n == -2)
+        return true;
+    vartype_list *slist = (vartype_list *) new_list(f->n == -1 ? 3 : 4);
+    if (slist == NULL)
+        return false;
+    vartype **stk_data = slist->array->data;
+    for (int i = 0; i < slist->size; i++)
+        stk_data[i] = NULL;
+    vartype_list *tlist = NULL;
+    vartype **tdata = NULL;
+    bool ret = false;
+    int len = f->n == -1 ? 1 : (signed char) f->state[4] == -1 ? 5 + f->lasterr_length : 5;
+    stk_data[0] = new_real(f->n);
+    stk_data[1] = new_string(NULL, len);
+    if (stk_data[0] == NULL || stk_data[1] == NULL)
+        goto done;
+    vartype_string *state;
+    state = (vartype_string *) stk_data[1];
+    memcpy(state->txt(), f->state, len < 5 ? len : 5);
+    if (len > 5)
+        memcpy(state->txt() + 5, f->lasterr_text, len - 5);
+    if (f->stack != NULL) {
+        tlist = (vartype_list *) new_list(0);
+        if (tlist == NULL)
+            goto done;
+        tdata = tlist->array->data;
+        tlist->array->data = f->stack;
+        tlist->size = f->stack_size;
+        stk_data[2] = (vartype *) tlist;
+    }
+    if (f->n != -1)
+        stk_data[3] = f->lastx;
+    ret = write_char(3)
+        && fwrite("STK", 1, 3, gfile) == 3
+        && write_int2(level)
+        && write_int2(VAR_PRIVATE)
+        && persist_vartype((vartype *) slist);
+
+    done:
+    if (tlist != NULL) {
+        tlist->array->data = tdata;
+        tlist->size = 0;
+    }
+    if (f->n != -1)
+        stk_data[3] = NULL;
+    free_vartype((vartype *) slist);
+    return ret;
+}
+
+/* Turns the private STK variables written by persist_func_frame() back
+ * into FUNC frames, and removes them from the variables list. Levels that
+ * are marked as having FUNC state but have no STK variable were saved by a
+ * version before 47; they get a frame with mode -2, so that returning from
+ * them fails the same way it did before.
+ */
+static bool unpersist_func_frames(bool level_0_func) {
+    for (int lvl = 0; lvl <= rtn_level; lvl++) {
+        if (lvl == 0) {
+            if (!level_0_func)
+                continue;
+        } else {
+            if ((rtn_stack[lvl - 1].prgm & RTN_HAS_FUNC) == 0)
+                continue;
+            rtn_stack[lvl - 1].prgm &= ~RTN_HAS_FUNC;
+        }
+        func_frame *f = new_func_frame();
+        if (f == NULL)
+            return false;
+        f->n = -2;
+        int i;
+        for (i = vars_count - 1; i >= 0; i--)
+            if (vars[i].level == lvl && (vars[i].flags & VAR_PRIVATE) != 0
+                    && string_equals(vars[i].name, vars[i].length, "STK", 3))
+                break;
+        if (i >= 0) {
+            vartype_list *slist = (vartype_list *) vars[i].value;
+            if (slist == NULL || slist->type != TYPE_LIST || slist->size < 3) {
+                bad_stk:
+                free_func_frame(f);
+                return false;
+            }
+            vartype **stk_data = slist->array->data;
+            if (stk_data[0] == NULL || stk_data[0]->type != TYPE_REAL
+                    || stk_data[1] == NULL || stk_data[1]->type != TYPE_STRING
+                    || stk_data[2] != NULL && stk_data[2]->type != TYPE_LIST)
+                goto bad_stk;
+            f->n = to_int(((vartype_real *) stk_data[0])->x);
+            vartype_string *state = (vartype_string *) stk_data[1];
+            if (state->length < (f->n == -1 ? 1 : 5) || state->length > 27)
+                goto bad_stk;
+            if (f->n != -1 && (slist->size < 4 || stk_data[2] == NULL))
+                goto bad_stk;
+            memcpy(f->state, state->txt(), state->length < 5 ? state->length : 5);
+            if (state->length > 5) {
+                f->lasterr_length = state->length - 5;
+                memcpy(f->lasterr_text, state->txt() + 5, f->lasterr_length);
+            }
+            vartype_list *tlist = (vartype_list *) stk_data[2];
+            if (tlist != NULL) {
+                // The RPN stack must always have capacity >= 4
+                int4 size = tlist->size;
+                int4 cap = size < 4 ? 4 : size;
+                f->stack = (vartype **) malloc(cap * sizeof(vartype *));
+                if (f->stack == NULL)
+                    goto bad_stk;
+                f->stack_capacity = cap;
+                bool shared = tlist->array->refcount > 1;
+                for (f->stack_size = 0; f->stack_size < size; f->stack_size++) {
+                    vartype **v = tlist->array->data + f->stack_size;
+                    if (shared) {
+                        f->stack[f->stack_size] = dup_vartype(*v);
+                        if (f->stack[f->stack_size] == NULL)
+                            goto bad_stk;
+                    } else {
+                        f->stack[f->stack_size] = *v;
+                        *v = NULL;
+                    }
+                }
+            }
+            if (f->n != -1) {
+                f->lastx = stk_data[3];
+                stk_data[3] = NULL;
+            }
+            free_vartype((vartype *) slist);
+            memmove(vars + i, vars + i + 1, (vars_count - i - 1) * sizeof(var_struct));
+            vars_count--;
+        }
+        if (lvl == 0)
+            rtn_level_0_func = f;
+        else
+            rtn_stack[lvl - 1].func = f;
+    }
+    return true;
+}
+
 static bool persist_globals() {
     int i;
-    array_count = 0;
-    array_list_capacity = 0;
-    array_list = NULL;
+    array_list_init();
     bool ret = false;
 
     if (!write_int(sp))
@@ -1396,9 +1784,23 @@ static bool persist_globals() {
         goto done;
     if (!write_int(prgm_highlight_row))
         goto done;
-    if (!write_int(vars_count))
+    int frames_count;
+    frames_count = 0;
+    for (i = 0; i <= rtn_level; i++) {
+        func_frame *f = func_frame_at(i);
+        if (f != NULL && f->n != -2)
+            frames_count++;
+    }
+    if (!write_int(vars_count + frames_count))
         goto done;
+    int frame_level;
+    frame_level = 0;
     for (i = 0; i < vars_count; i++) {
+        // Each frame's STK goes before the other locals at its level,
+        // since FUNC is normally the first thing a subroutine does
+        for (; frame_level <= vars[i].level; frame_level++)
+            if (!persist_func_frame(frame_level))
+                goto done;
         if (!write_char(vars[i].length)
             || fwrite(vars[i].name, 1, vars[i].length, gfile) != vars[i].length
             || !write_int2(vars[i].level)
@@ -1406,6 +1808,9 @@ static bool persist_globals() {
             || !persist_vartype(vars[i].value))
             goto done;
     }
+    for (; frame_level <= rtn_level; frame_level++)
+        if (!persist_func_frame(frame_level))
+            goto done;
     if (!write_int(varmenu_length))
         goto done;
     if (fwrite(varmenu, 1, 7, gfile) != 7)
@@ -1424,19 +1829,25 @@ static bool persist_globals() {
         goto done;
     if (!write_bool(rtn_level_0_has_matrix_entry))
         goto done;
-    if (!write_bool(rtn_level_0_has_func_state))
+    if (!write_bool(rtn_level_0_func != NULL))
         goto done;
-    int saved_prgm;
-    saved_prgm = current_prgm;
+    int4 *lines;
+    lines = (int4 *) malloc(rtn_level * sizeof(int4));
+    if (lines == NULL && rtn_level > 0)
+        goto done;
+    for (i = 0; i < rtn_level; i++)
+        lines[i] = rtn_stack[i].pc;
+    convert_rtn_locations(lines, true);
     for (i = rtn_level - 1; i >= 0; i--) {
-        current_prgm = rtn_stack[i].get_prgm();
-        int4 line = rtn_stack[i].pc;
-        if (current_prgm >= 0)
-            line = pc2line(line);
-        if (!write_int4(rtn_stack[i].prgm) || !write_int4(line))
+        int4 prgm = rtn_stack[i].prgm;
+        if (rtn_stack[i].func != NULL)
+            prgm |= RTN_HAS_FUNC;
+        if (!write_int4(prgm) || !write_int4(lines[i])) {
+            free(lines);
             goto done;
+        }
     }
-    current_prgm = saved_prgm;
+    free(lines);
     if (!write_bool(rtn_solve_active))
         goto done;
     if (!write_bool(rtn_integ_active))
@@ -1444,7 +1855,7 @@ static bool persist_globals() {
     ret = true;
 
     done:
-    free(array_list);
+    array_list_cleanup();
     return ret;
 }
 
@@ -1452,9 +1863,7 @@ bool loading_state = false;
 
 static bool unpersist_globals() {
     int i;
-    array_count = 0;
-    array_list_capacity = 0;
-    array_list = NULL;
+    array_list_init();
     bool ret = false;
     char tmp_dmy = 2;
 
@@ -1666,30 +2075,56 @@ static bool unpersist_globals() {
     }
     if (!read_int(&rtn_level))
         goto done;
-    if (!read_bool(&rtn_level_0_has_matrix_entry))
+    if (rtn_level < 0 || rtn_level > MAX_RTN_LEVEL) {
+        // Saved by a build with a higher MAX_RTN_LEVEL, or corrupt; either
+        // way, this return stack can't be resumed here.
+        rtn_level = 0;
         goto done;
+    }
+    // Until the return stack has been reallocated and initialized, below,
+    // rtn_level must stay 0, or clear_func_frames() would look at garbage
+    // after a failed load.
+    if (!read_bool(&rtn_level_0_has_matrix_entry)) {
+        rtn_level = 0;
+        goto done;
+    }
+    bool level_0_func;
     if (ver >= 31) {
-        if (!read_bool(&rtn_level_0_has_func_state))
+        if (!read_bool(&level_0_func)) {
+            rtn_level = 0;
             goto done;
+        }
     } else {
-        rtn_level_0_has_func_state = false;
+        level_0_func = false;
+    }
+    {
+        int new_rtn_stack_capacity = 16;
+        while (rtn_level > new_rtn_stack_capacity)
+            new_rtn_stack_capacity <<= 1;
+        rtn_stack_entry *new_rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, new_rtn_stack_capacity * sizeof(rtn_stack_entry));
+        if (new_rtn_stack == NULL) {
+            rtn_level = 0;
+            goto done;
+        }
+        rtn_stack = new_rtn_stack;
+        rtn_stack_capacity = new_rtn_stack_capacity;
+        for (i = 0; i < rtn_level; i++)
+            rtn_stack[i].func = NULL;
     }
-    rtn_stack_capacity = 16;
-    while (rtn_level > rtn_stack_capacity)
-        rtn_stack_capacity <<= 1;
-    rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, rtn_stack_capacity * sizeof(rtn_stack_entry));
     if (ver >= 47) {
-        int saved_prgm = current_prgm;
+        int4 *lines = (int4 *) malloc(rtn_level * sizeof(int4));
+        if (lines == NULL && rtn_level > 0)
+            goto done;
         for (i = rtn_level - 1; i >= 0; i--) {
-            int4 line;
-            if (!read_int4(&rtn_stack[i].prgm)) goto done;
-            if (!read_int4(&line)) goto done;
-            current_prgm = rtn_stack[i].get_prgm();
-            if (current_prgm >= 0)
-                line = line2pc(line);
-            rtn_stack[i].pc = line;
+            if (!read_int4(&rtn_stack[i].prgm) || !read_int4(&lines[i])) {
+                free(lines);
+                goto done;
+            }
         }
-        current_prgm = saved_prgm;
+        convert_rtn_locations(lines, false);
+        for (i = 0; i < rtn_level; i++)
+            rtn_stack[i].pc = lines[i];
+        free(lines);
     } else {
         int saved_prgm = current_prgm;
         for (int lvl = rtn_level - 1; lvl >= -1; lvl--) {
@@ -1767,6 +2202,9 @@ static bool unpersist_globals() {
         }
         current_prgm = saved_prgm;
     }
+    if (!unpersist_func_frames(level_0_func))
+        goto done;
+    index_local_vars();
     if (!read_bool(&rtn_solve_active))
         goto done;
     if (!read_bool(&rtn_integ_active))
@@ -1775,7 +2213,7 @@ static bool unpersist_globals() {
     ret = true;
 
     done:
-    free(array_list);
+    array_list_cleanup();
     return ret;
 }
 
@@ -1795,6 +2233,7 @@ void clear_all_prgms() {
     labels = NULL;
     labels_capacity = 0;
     labels_count = 0;
+    labels_changed();
 }
 
 int clear_prgm(const arg_struct *arg) {
@@ -1845,6 +2284,7 @@ int clear_prgm_by_index(int prgm_index) {
             i++;
     }
     labels_count = i;
+    labels_changed();
     if (prgms_count == 0 || prgm_index == prgms_count) {
         int saved_prgm = current_prgm;
         int saved_pc = pc;
@@ -1894,6 +2334,7 @@ void clear_prgm_lines(int4 count) {
             i++;
     }
     labels_count = i;
+    labels_changed();
 
     invalidate_lclbls(current_prgm, false);
     clear_all_rtns();
@@ -1936,12 +2377,27 @@ void goto_dot_dot(bool force_new) {
     pc = -1;
 }
 
+/* Cached result of mvar_prgms_exist(): -1 if unknown, else 0 or 1. The
+ * MVAR check looks at the line after each label, so this is reset on every
+ * program edit, not just when labels are added or removed.
+ */
+static int mvar_prgms_state = -1;
+
+static void labels_changed() {
+    mvar_prgms_state = -1;
+    invalidate_catalog_index();
+}
+
 bool mvar_prgms_exist() {
-    int i;
-    for (i = 0; i < labels_count; i++)
-        if (label_has_mvar(i))
-            return true;
-    return false;
+    if (mvar_prgms_state == -1) {
+        mvar_prgms_state = 0;
+        for (int i = 0; i < labels_count; i++)
+            if (label_has_mvar(i)) {
+                mvar_prgms_state = 1;
+                break;
+            }
+    }
+    return mvar_prgms_state == 1;
 }
 
 bool label_has_mvar(int lblindex) {
@@ -2176,10 +2632,12 @@ void rebuild_label_table() {
             pc += get_command_length(prgm_index, pc);
         }
     }
+    labels_changed();
 }
 
 static void update_label_table(int prgm, int4 pc, int inserted) {
     int i;
+    labels_changed();
     for (i = 0; i < labels_count; i++) {
         if (labels[i].prgm > prgm)
             return;
@@ -2785,10 +3243,12 @@ bool find_global_label_index(const arg_struct *arg, int *idx) {
 }
 
 int push_rtn_addr(int prgm, int4 pc) {
-    if (rtn_level == MAX_RTN_LEVEL)
+    if (rtn_level >= MAX_RTN_LEVEL)
         return ERR_RTN_STACK_FULL;
     if (rtn_level == rtn_stack_capacity) {
-        int new_rtn_stack_capacity = rtn_stack_capacity + 16;
+        int new_rtn_stack_capacity = rtn_stack_capacity == 0 ? 16 : rtn_stack_capacity * 2;
+        if (new_rtn_stack_capacity > MAX_RTN_LEVEL)
+            new_rtn_stack_capacity = MAX_RTN_LEVEL;
         rtn_stack_entry *new_rtn_stack = (rtn_stack_entry *) realloc(rtn_stack, new_rtn_stack_capacity * sizeof(rtn_stack_entry));
         if (new_rtn_stack == NULL)
             return ERR_INSUFFICIENT_MEMORY;
@@ -2797,6 +3257,7 @@ int push_rtn_addr(int prgm, int4 pc) {
     }
     rtn_stack[rtn_level].set_prgm(prgm);
     rtn_stack[rtn_level].pc = pc;
+    rtn_stack[rtn_level].func = NULL;
     rtn_level++;
     if (prgm == -2)
         rtn_solve_active = true;
@@ -2866,7 +3327,8 @@ void maybe_pop_indexed_matrix(const char *name, int len) {
         rtn_stack[rtn_level - 1].set_has_matrix(false);
 }
 
-/* Layout of STK list used to save state for FUNC and LNSTK/L4STK:
+/* FUNC and LNSTK/L4STK save their state in a func_frame. In the state file,
+ * a frame is stored as a private STK list, with this layout:
  * 0: Mode: [0-4][0-4] for FUNC, or -1 for stand-alone LNSTK/L4STK;
  * 1: State: "ABCDE<Text>" where A=Caller Big Stack, B=LNSTK/L4STK after FUNC,
  *    C=CSLD, D=F25, E=ERRNO, <Text>=ERRMSG
@@ -2877,6 +3339,33 @@ void maybe_pop_indexed_matrix(const char *name, int len) {
  * 3: Saved LASTX (FUNC only)
  */
 
+/* Takes the frame's spare stack array, or allocates a new one. Either way,
+ * the capacity is at least 4, as the RPN stack requires.
+ */
+static vartype **take_func_stack(func_frame *f, int4 *capacity) {
+    vartype **s = f->spare;
+    if (s != NULL) {
+        *capacity = f->spare_capacity;
+        f->spare = NULL;
+        return s;
+    }
+    *capacity = 4;
+    return (vartype **) malloc(4 * sizeof(vartype *));
+}
+
+/* Exchanges the RPN stack with the one saved in the frame. */
+static void swap_func_stack(func_frame *f) {
+    vartype **tmpstk = stack;
+    int4 tmpsize = sp + 1;
+    int4 tmpcap = stack_capacity;
+    stack = f->stack;
+    sp = f->stack_size - 1;
+    stack_capacity = f->stack_capacity;
+    f->stack = tmpstk;
+    f->stack_size = tmpsize;
+    f->stack_capacity = tmpcap;
+}
+
 int push_func_state(int n) {
     if (!program_running())
         return ERR_RESTRICTED_OPERATION;
@@ -2884,90 +3373,65 @@ int push_func_state(int n) {
     if (sp + 1 < inputs)
         return ERR_TOO_FEW_ARGUMENTS;
 
-    vartype *stk = recall_private_var("STK", 3);
-    if (stk != NULL)
+    func_frame **slot = func_frame_slot();
+    if (*slot != NULL)
         return ERR_INVALID_CONTEXT;
-    if (!ensure_var_space(1))
-        return ERR_INSUFFICIENT_MEMORY;
-
-    /* Create the STK list */
-    stk = new_list(4);
-    if (stk == NULL)
+    func_frame *f = new_func_frame();
+    if (f == NULL)
         return ERR_INSUFFICIENT_MEMORY;
-    vartype_list *slist = (vartype_list *) stk;
-    slist->array->data[0] = new_real(n);
-    slist->array->data[1] = new_string(NULL, lasterr == -1 ? 5 + lasterr_length : 5);
-    int i;
-    for (i = 0; i < 2; i++)
-        if (slist->array->data[i] == NULL) {
-            nomem1:
-            free_vartype(stk);
-            return ERR_INSUFFICIENT_MEMORY;
-        }
 
-    /* Create the new stack
-     * Note that we're creating a list here, while the actual stack is just
-     * a plain array of (vartype *). We'll swap the array in this list with
-     * the one for the RPN stack once all allocations have been done, and then
-     * use this list to store the old stack in the STK list.
+    /* Create the new stack: the parameters, padded to depth 4 with zeros
+     * in 4STK mode. It is kept in the frame until all allocations have been
+     * done, and then swapped with the RPN stack.
      */
     int newdepth = flags.f.big_stack ? inputs : 4;
-    // Allocating size 4 because the stack must always have capacity >= 4
-    vartype_list *tlist = (vartype_list *) new_list(4);
-    tlist->size = newdepth;
-    if (tlist == NULL)
-        goto nomem1;
-    for (i = 0; i < newdepth; i++) {
-        tlist->array->data[newdepth - 1 - i] = i < inputs ? dup_vartype(stack[sp - i]) : new_real(0);
-        if (tlist->array->data[newdepth - 1 - i] == NULL) {
-            nomem2:
-            free_vartype((vartype *) tlist);
-            goto nomem1;
-        }
+    int pad = newdepth - inputs;
+    vartype *newlastx = NULL;
+    int4 i = 0;
+    f->stack = take_func_stack(f, &f->stack_capacity);
+    if (f->stack == NULL)
+        goto nomem;
+    for (; i < newdepth; i++) {
+        f->stack[i] = i < pad ? new_real(0) : dup_vartype(stack[sp - newdepth + 1 + i]);
+        if (f->stack[i] == NULL)
+            goto nomem;
+    }
+    newlastx = new_real(0);
+    if (newlastx == NULL) {
+        nomem:
+        f->stack_size = i;
+        free_func_frame(f);
+        return ERR_INSUFFICIENT_MEMORY;
     }
-
-    vartype *newlastx = new_real(0);
-    if (newlastx == NULL)
-        goto nomem2;
 
     /* OK, we have everything we need. Now move it all into place... */
-    vartype_string *s = (vartype_string *) slist->array->data[1];
-    s->txt()[0] = flags.f.big_stack ? '1' : '0';
-    s->txt()[1] = '0';
-    s->txt()[2] = sp != -1 && is_csld() ? '1' : '0';
-    s->txt()[3] = flags.f.error_ignore ? '1' : '0';
-    s->txt()[4] = (char) lasterr;
-    if (lasterr == -1)
-        memcpy(s->txt() + 5, lasterr_text, lasterr_length);
-    vartype **tmpstk = tlist->array->data;
-    int4 tmpdepth = tlist->size;
-    tlist->array->data = stack;
-    tlist->size = sp + 1;
-    stack = tmpstk;
-    stack_capacity = 4;
-    sp = tmpdepth - 1;
-    slist->array->data[2] = (vartype *) tlist;
-    slist->array->data[3] = lastx;
+    f->n = n;
+    f->state[0] = flags.f.big_stack ? '1' : '0';
+    f->state[1] = '0';
+    f->state[2] = sp != -1 && is_csld() ? '1' : '0';
+    f->state[3] = flags.f.error_ignore ? '1' : '0';
+    f->state[4] = (char) lasterr;
+    if (lasterr == -1) {
+        f->lasterr_length = lasterr_length;
+        memcpy(f->lasterr_text, lasterr_text, lasterr_length);
+    }
+    f->stack_size = newdepth;
+    swap_func_stack(f);
+    f->lastx = lastx;
     lastx = newlastx;
+    *slot = f;
 
-    store_private_var("STK", 3, stk);
     flags.f.error_ignore = 0;
     lasterr = ERR_NONE;
-
-    if (rtn_level == 0)
-        rtn_level_0_has_func_state = true;
-    else
-        rtn_stack[rtn_level - 1].set_has_func(true);
     return ERR_NONE;
 }
 
 int push_stack_state(bool big) {
-    vartype *stk = recall_private_var("STK", 3);
-    if (stk != NULL) {
+    func_frame **slot = func_frame_slot();
+    func_frame *f = *slot;
+    if (f != NULL) {
         /* LNSTK/L4STK after FUNC */
-        vartype_list *slist = (vartype_list *) stk;
-        vartype_string *s = (vartype_string *) slist->array->data[1];
-        if (s->length == 1 || s->txt()[1] != '0')
+        if (f->n < 0 || f->state[1] != '0')
             /* LNSTK/L4STK after LNSTK/L4STK: not allowed */
             return ERR_INVALID_CONTEXT;
         if ((bool) flags.f.big_stack == big) {
@@ -2977,8 +3441,7 @@ int push_stack_state(bool big) {
              * the stack contains the parameters, padded to depth 4
              * with zeros. We just remove the padding now.
              */
-            vartype_real *mode = (vartype_real *) slist->array->data[0];
-            int inputs = to_int(mode->x) / 10;
+            int inputs = f->n / 10;
             int excess = 4 - inputs;
             if (excess > 0) {
                 for (int i = 0; i < excess; i++)
@@ -2996,101 +3459,55 @@ int push_stack_state(bool big) {
             if (err != ERR_NONE)
                 return err;
         }
-        s->txt()[1] = '1';
+        f->state[1] = '1';
         return ERR_NONE;
     } else {
         /* Stand-alone LNSTK/L4STK */
-
-        bool save_stk = flags.f.big_stack && !big;
-
-        /* Create the STK list */
-        stk = new_list(3);
-        if (stk == NULL)
+        f = new_func_frame();
+        if (f == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        vartype_list *slist = (vartype_list *) stk;
-        slist->array->data[0] = new_real(-1);
-        slist->array->data[1] = new_string(flags.f.big_stack ? "1" : "0", 1);
-        slist->array->data[2] = NULL;
-        int i;
-        for (i = 0; i < 2; i++)
-            if (slist->array->data[i] == NULL) {
-                nomem:
-                free_vartype(stk);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
+        f->n = -1;
+        f->state[0] = flags.f.big_stack ? '1' : '0';
 
         /* When switching from NSTK to 4STK, save the stack */
-        if (save_stk) {
-            vartype_list *tlist = (vartype_list *) new_list(4);
-            if (tlist == NULL)
-                goto nomem;
-            for (i = 0; i < 4; i++) {
-                tlist->array->data[3 - i] = i <= sp ? dup_vartype(stack[sp - i]) : new_real(0);
-                if (tlist->array->data[3 - i] == NULL) {
-                    free_vartype((vartype *) tlist);
-                    goto nomem;
+        if (flags.f.big_stack && !big) {
+            f->stack = take_func_stack(f, &f->stack_capacity);
+            if (f->stack == NULL) {
+                free_func_frame(f);
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+            for (int4 i = 0; i < 4; i++) {
+                f->stack[i] = 3 - i <= sp ? dup_vartype(stack[sp - 3 + i]) : new_real(0);
+                if (f->stack[i] == NULL) {
+                    f->stack_size = i;
+                    free_func_frame(f);
+                    return ERR_INSUFFICIENT_MEMORY;
                 }
             }
-            vartype **tmpstk = tlist->array->data;
-            int4 tmpdepth = tlist->size;
-            tlist->array->data = stack;
-            tlist->size = sp + 1;
-            stack = tmpstk;
-            stack_capacity = tmpdepth;
-            sp = tmpdepth - 1;
-            slist->array->data[2] = (vartype *) tlist;
+            f->stack_size = 4;
+            swap_func_stack(f);
         }
 
-        store_private_var("STK", 3, stk);
+        *slot = f;
         flags.f.big_stack = big;
-
-        if (rtn_level == 0)
-            rtn_level_0_has_func_state = true;
-        else
-            rtn_stack[rtn_level - 1].set_has_func(true);
         return ERR_NONE;
     }
 }
 
-/* FUNC and L4STK save the stack in a list, but this has one undesirable
- * side effect: if the state is saved and restored, the array inside the
- * list will be created without any spare room. This is bad when restoring
- * the stack, because there is the assumption that the stack array will
- * always have capacity >= 4. This function makes sure the array has that
- * capacity.
- */
-static bool ensure_list_capacity_4(vartype_list *list) {
-    int4 size = list->size;
-    if (size < 4) {
-        vartype **newdata = (vartype **) realloc(list->array->data, 4 * sizeof(vartype *));
-        if (newdata == NULL)
-            return false;
-        list->array->data = newdata;
-    }
-    return true;
-}
-
 int pop_func_state(bool error) {
-    if (rtn_level == 0) {
-        if (!rtn_level_0_has_func_state)
-            return ERR_NONE;
-    } else {
-        if (!rtn_stack[rtn_level - 1].has_func())
-            return ERR_NONE;
-    }
-
-    vartype_list *stk = (vartype_list *) recall_private_var("STK", 3);
-    if (stk == NULL)
+    func_frame **slot = func_frame_slot();
+    func_frame *f = *slot;
+    if (f == NULL)
+        return ERR_NONE;
+    if (f->n == -2)
         // Older FD/ST-based FUNC logic, pre-47. Too difficult to deal with, so
         // we punt. Note that this can only happen if a user upgrades from <47
         // to >=47 while execution is stopped with old FUNC data on the stack.
         // That seems like a reasonable scenario to ignore.
         return ERR_INVALID_DATA;
 
-    vartype **stk_data = stk->array->data;
-    int n = to_int(((vartype_real *) stk_data[0])->x);
-    vartype_string *state = (vartype_string *) stk_data[1];
-    bool big = state->txt()[0] == '1';
+    int n = f->n;
+    bool big = f->state[0] == '1';
     if (big && !core_settings.allow_big_stack)
         return ERR_BIG_STACK_DISABLED;
 
@@ -3098,33 +3515,24 @@ int pop_func_state(bool error) {
     if (false) {
         error:
         free_vartype(lastx);
-        lastx = stk_data[3];
-        stk_data[3] = NULL;
+        lastx = f->lastx;
+        f->lastx = NULL;
         goto done;
     }
 
     if (n == -1) {
         // Stand-alone LNSTK/L4STK
-        if (big && !flags.f.big_stack && stk_data[2] != NULL) {
+        if (big && !flags.f.big_stack && f->stack != NULL) {
             // Extend the stack back to its original size, restoring its
             // original contents, but only those above level 4.
-            vartype_list *tlist = (vartype_list *) stk_data[2];
-            if (!ensure_list_capacity_4(tlist))
-                return ERR_INSUFFICIENT_MEMORY;
-            while (tlist->size < 4)
-                tlist->array->data[tlist->size++] = NULL;
+            while (f->stack_size < 4)
+                f->stack[f->stack_size++] = NULL;
             for (int i = 0; i < 4; i++) {
-                free_vartype(tlist->array->data[tlist->size - 1 - i]);
-                tlist->array->data[tlist->size - 1 - i] = stack[sp - i];
+                free_vartype(f->stack[f->stack_size - 1 - i]);
+                f->stack[f->stack_size - 1 - i] = stack[sp - i];
                 stack[sp - i] = NULL;
             }
-            vartype **tmpstk = stack;
-            int tmpsize = sp + 1;
-            stack = tlist->array->data;
-            stack_capacity = tlist->size;
-            sp = stack_capacity - 1;
-            tlist->array->data = tmpstk;
-            tlist->size = tmpsize;
+            swap_func_stack(f);
         } else if (!big && flags.f.big_stack) {
             if (sp < 3) {
                 int extra = 3 - sp;
@@ -3156,21 +3564,9 @@ int pop_func_state(bool error) {
         }
     } else {
         // FUNC, with or without LNSTK/L4STK
-        vartype_list *tlist = (vartype_list *) stk_data[2];
-        if (!ensure_list_capacity_4(tlist)) {
-            err = ERR_INSUFFICIENT_MEMORY;
-            goto error;
-        }
-
-        vartype **tmpstk = stack;
-        int tmpsize = sp + 1;
-        stack = tlist->array->data;
-        stack_capacity = tlist->size;
-        sp = stack_capacity - 1;
-        if (stack_capacity < 4)
-            stack_capacity = 4;
-        tlist->array->data = tmpstk;
-        tlist->size = tmpsize;
+        swap_func_stack(f);
+        vartype **tmpstk = f->stack;
+        int tmpsize = f->stack_size;
 
         if (error)
             goto error;
@@ -3190,7 +3586,7 @@ int pop_func_state(bool error) {
                     nomem = true;
             }
             tmpsize += deficit;
-            tlist->size = tmpsize;
+            f->stack_size = tmpsize;
             if (nomem) {
                 err = ERR_INSUFFICIENT_MEMORY;
                 goto error;
@@ -3198,7 +3594,7 @@ int pop_func_state(bool error) {
         }
 
         bool do_lastx = inputs > 0;
-        if (n == 1 && state->txt()[2] == '1')
+        if (n == 1 && f->state[2] == '1')
             // RCL-like function with stack lift disabled
             inputs = 1;
         int growth = outputs - inputs;
@@ -3213,8 +3609,8 @@ int pop_func_state(bool error) {
                 lastx = stack[sp];
                 stack[sp] = NULL;
             } else {
-                lastx = stk_data[3];
-                stk_data[3] = NULL;
+                lastx = f->lastx;
+                f->lastx = NULL;
             }
             for (int i = 0; i < inputs; i++) {
                 free_vartype(stack[sp - i]);
@@ -3243,8 +3639,8 @@ int pop_func_state(bool error) {
                 lastx = stack[sp];
                 stack[sp] = NULL;
             } else {
-                lastx = stk_data[3];
-                stk_data[3] = NULL;
+                lastx = f->lastx;
+                f->lastx = NULL;
             }
             for (int i = 0; i < inputs; i++) {
                 free_vartype(stack[sp - i]);
@@ -3266,19 +3662,17 @@ int pop_func_state(bool error) {
             }
         }
 
-        flags.f.error_ignore = state->txt()[3] == '1';
-        lasterr = (signed char) state->txt()[4];
+        flags.f.error_ignore = f->state[3] == '1';
+        lasterr = (signed char) f->state[4];
         if (lasterr == -1) {
-            lasterr_length = state->length - 5;
-            memcpy(lasterr_text, state->txt() + 5, lasterr_length);
+            lasterr_length = f->lasterr_length;
+            memcpy(lasterr_text, f->lasterr_text, lasterr_length);
         }
     }
 
     done:
-    if (rtn_level == 0)
-        rtn_level_0_has_func_state = false;
-    else
-        rtn_stack[rtn_level - 1].set_has_func(false);
+    *slot = NULL;
+    free_func_frame(f);
 
     flags.f.big_stack = big;
     print_trace();
@@ -3305,8 +3699,12 @@ bool should_i_stop_at_this_level() {
 static void remove_locals() {
     if (matedit_mode == 3 && matedit_level >= rtn_level)
         leave_matrix_editor();
+    if (local_vars_count == 0)
+        return;
     int last = -1;
-    for (int i = vars_count - 1; i >= 0; i--) {
+    int removed = 0;
+    bool visible = false;
+    for (int i = vars_count - 1; i >= 0 && removed < local_vars_count; i--) {
         if (vars[i].level == -1)
             continue;
         if (vars[i].level < rtn_level)
@@ -3323,19 +3721,19 @@ static void remove_locals() {
             matedit_stack = NULL;
             matedit_stack_depth = 0;
         }
-        if ((vars[i].flags & VAR_HIDING) != 0) {
-            for (int j = i - 1; j >= 0; j--)
-                if ((vars[j].flags & VAR_HIDDEN) != 0 && string_equals(vars[i].name, vars[i].length, vars[j].name, vars[j].length)) {
-                    vars[j].flags &= ~VAR_HIDDEN;
-                    break;
-                }
-        }
+        if ((vars[i].flags & VAR_HIDING) != 0)
+            vars[vars[i].hides].flags &= ~VAR_HIDDEN;
+        if ((vars[i].flags & VAR_PRIVATE) == 0)
+            visible = true;
         free_vartype(vars[i].value);
         vars[i].length = 100;
         last = i;
+        removed++;
     }
     if (last == -1)
         return;
+    // Only globals can follow 'last' at this point, and those never hide
+    // anything, so no 'hides' indexes need adjusting.
     int from = last;
     int to = last;
     while (from < vars_count) {
@@ -3344,7 +3742,12 @@ static void remove_locals() {
         from++;
     }
     vars_count -= from - to;
-    update_catalog();
+    local_vars_count -= removed;
+    vars_changed();
+    // Returning from FUNC removes only private variables; no need to
+    // refresh the catalog for those.
+    if (visible)
+        update_catalog();
 }
 
 int rtn(int err) {
@@ -3430,11 +3833,15 @@ void pop_rtn_addr(int *prgm, int4 *pc, bool *stop) {
             rtn_stack[rtn_level - 1].set_has_matrix(false);
     }
     remove_locals();
+    func_frame **slot = func_frame_slot();
+    if (*slot != NULL) {
+        free_func_frame(*slot);
+        *slot = NULL;
+    }
     if (rtn_level == 0) {
         *prgm = -1;
         *pc = -1;
         rtn_stop_level = -1;
-        rtn_level_0_has_func_state = false;
     } else {
         rtn_level--;
         *prgm = rtn_stack[rtn_level].get_prgm();
@@ -3452,18 +3859,10 @@ void pop_rtn_addr(int *prgm, int4 *pc, bool *stop) {
 }
 
 static void get_saved_stack_mode(int *m) {
-    if (rtn_level == 0) {
-        if (!rtn_level_0_has_func_state)
-            return;
-    } else {
-        if (!rtn_stack[rtn_level - 1].has_func())
-            return;
-    }
-    vartype_list *stk = (vartype_list *) recall_private_var("STK", 3);
-    if (stk == NULL)
+    func_frame *f = *func_frame_slot();
+    if (f == NULL || f->n == -2)
         return;
-    vartype **stk_data = stk->array->data;
-    *m = ((vartype_string *) stk_data[1])->txt()[0] == '1';
+    *m = f->state[0] == '1';
 }
 
 void clear_all_rtns() {
@@ -3942,7 +4341,10 @@ static bool load_state2(bool *clear, bool *too_new) {
         if (!read_int(&matedit_level)) return false;
     if (fread(matedit_name, 1, 7, gfile) != 7) return false;
     if (!read_int(&matedit_length)) return false;
-    if (!unpersist_vartype(&matedit_x)) return false;
+    array_list_init();
+    bool matedit_x_ok = unpersist_vartype(&matedit_x);
+    array_list_cleanup();
+    if (!matedit_x_ok) return false;
     if (!read_int4(&matedit_i)) return false;
     if (!read_int4(&matedit_j)) return false;
     if (!read_int(&matedit_prev_appmenu)) return false;
@@ -4118,7 +4520,10 @@ void save_state(bool *success) {
     if (!write_int(matedit_level)) return;
     if (fwrite(matedit_name, 1, 7, gfile) != 7) return;
     if (!write_int(matedit_length)) return;
-    if (!persist_vartype(matedit_x)) return;
+    array_list_init();
+    bool matedit_x_ok = persist_vartype(matedit_x);
+    array_list_cleanup();
+    if (!matedit_x_ok) return;
     if (!write_int4(matedit_i)) return;
     if (!write_int4(matedit_j)) return;
     if (!write_int(matedit_prev_appmenu)) return;
@@ -4188,6 +4593,7 @@ void hard_reset(int reason) {
     store_var("REGS", 4, regs);
 
     /* Clear RTN stack */
+    clear_func_frames();
     if (rtn_stack != NULL)
         free(rtn_stack);
     rtn_stack_capacity = 16;
@@ -4210,6 +4616,7 @@ void hard_reset(int reason) {
         labels_capacity = 0;
         labels_count = 0;
     }
+    labels_changed();
     goto_dot_dot(false);
 
     pending_command = CMD_NONE;
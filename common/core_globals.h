@@ -345,10 +345,12 @@ struct var_struct {
     char name[7];
     int2 level;
     int2 flags;
+    int4 hides; /* For VAR_HIDING: index of the VAR_HIDDEN variable */
     vartype *value;
 };
 extern int vars_capacity;
 extern int vars_count;
+extern int local_vars_count;
 extern var_struct *vars;
 
 /* Programs */
@@ -575,6 +577,7 @@ int rtn(int err);
 int rtn_with_error(int err);
 void pop_rtn_addr(int *prgm, int4 *pc, bool *stop);
 void clear_all_rtns();
+void clear_func_frames();
 int get_rtn_level();
 void save_csld();
 bool is_csld();
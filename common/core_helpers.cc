@@ -431,37 +431,41 @@ bool string_equals(const char *s1, int s1len, const char *s2, int s2len) {
 }
 
 int string_pos(const char *ntext, int nlen, const vartype *hs, int startpos) {
-    int pos = -1;
     if (hs->type == TYPE_REAL) {
         phloat x = ((const vartype_real *) hs)->x;
-        char c;
-        int i;
         if (x < 0)
             x = -x;
         if (x >= 256)
             return -2;
-        c = to_char(x);
-        for (i = startpos; i < nlen; i++)
-            if (ntext[i] == c) {
-                pos = i;
-                break;
-            }
+        if (startpos >= nlen)
+            return -1;
+        const char *p = (const char *) memchr(ntext + startpos, to_char(x), nlen - startpos);
+        return p == NULL ? -1 : (int) (p - ntext);
     } else {
         const vartype_string *s = (const vartype_string *) hs;
-        if (s->length != 0) {
-            int i, j;
-            const char *text = s->txt();
-            for (i = startpos; i < nlen - s->length + 1; i++) {
-                for (j = 0; j < s->length; j++)
-                    if (ntext[i + j] != text[j])
-                        goto notfound;
-                pos = i;
+        int len = s->length;
+        if (len == 0 || startpos > nlen - len)
+            return -1;
+        /* Use memchr() to skip ahead to candidate positions, i.e. those
+         * where the first character matches, and only compare the rest of
+         * the string there. The library memchr() is typically vectorized,
+         * so this is much faster than comparing byte by byte at every
+         * position.
+         */
+        const char *text = s->txt();
+        char first = text[0];
+        const char *p = ntext + startpos;
+        const char *last = ntext + nlen - len;
+        while (p <= last) {
+            p = (const char *) memchr(p, first, last - p + 1);
+            if (p == NULL)
                 break;
-                notfound:;
-            }
+            if (memcmp(p + 1, text + 1, len - 1) == 0)
+                return (int) (p - ntext);
+            p++;
         }
+        return -1;
     }
-    return pos;
 }
 
 bool vartype_equals(const vartype *v1, const vartype *v2) {
@@ -484,7 +488,8 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
             if (x->array == y->array)
                 return true;
             int4 sz, i;
-            if (x->rows != y->rows || x->columns != y->columns)
+            if (x->rows != y->rows || x->columns != y->columns
+                    || x->array->string_count != y->array->string_count)
                 return false;
             sz = x->rows * x->columns;
             for (i = 0; i < sz; i++) {
@@ -1387,6 +1392,133 @@ phloat cos_grad(phloat x) {
     return sin_or_cos_grad(x, false);
 }
 
+/* Reductions for RSUM, RNRM, FNRM, and DOT. In the binary build, these
+ * use four independent partial sums, which the compiler can keep in vector
+ * registers, and which are always combined in the same order, so results
+ * are reproducible. They are not always the same as with a left-to-right
+ * sum, though: finite results can differ in the last bits, because the
+ * additions are done in a different order.
+ * Overflow is another matter. A partial sum can overflow where the
+ * left-to-right sum stays finite, e.g. with 1e308, -1e308, and 1e308 in
+ * different lanes, and the range error checks in the callers depend on
+ * the overflow behavior of the left-to-right sum. So, for signed terms,
+ * if the combined result is not finite, meaning a partial sum overflowed,
+ * the sum is done again, serially. With nonnegative terms, no partial sum
+ * can exceed the left-to-right sum, so no such check is needed.
+ * In the decimal build, the sums are always done left to right, so that
+ * results don't change.
+ */
+
+phloat sum_phloat(const phloat *data, int4 n, int4 stride) {
+    phloat sum = 0;
+    #ifndef BCD_MATH
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int4 i;
+        for (i = 0; i + 4 <= n; i += 4) {
+            s0 += data[i * stride];
+            s1 += data[(i + 1) * stride];
+            s2 += data[(i + 2) * stride];
+            s3 += data[(i + 3) * stride];
+        }
+        for (; i < n; i++)
+            s0 += data[i * stride];
+        sum = (s0 + s1) + (s2 + s3);
+        if (p_isinf(sum) == 0 && !p_isnan(sum))
+            return sum;
+        sum = 0;
+    #endif
+    for (int4 i = 0; i < n; i++)
+        sum += data[i * stride];
+    return sum;
+}
+
+phloat sum_abs_phloat(const phloat *data, int4 n) {
+    #ifdef BCD_MATH
+        phloat sum = 0;
+        for (int4 i = 0; i < n; i++) {
+            phloat x = data[i];
+            if (x >= 0)
+                sum += x;
+            else
+                sum -= x;
+        }
+        return sum;
+    #else
+        // All terms are nonnegative, so no overflow check is needed here
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int4 i;
+        for (i = 0; i + 4 <= n; i += 4) {
+            s0 += fabs(data[i]);
+            s1 += fabs(data[i + 1]);
+            s2 += fabs(data[i + 2]);
+            s3 += fabs(data[i + 3]);
+        }
+        for (; i < n; i++)
+            s0 += fabs(data[i]);
+        return (s0 + s1) + (s2 + s3);
+    #endif
+}
+
+phloat dot_phloat(const phloat *x, const phloat *y, int4 n, int4 ystride) {
+    phloat dot = 0;
+    #ifndef BCD_MATH
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int4 i;
+        for (i = 0; i + 4 <= n; i += 4) {
+            s0 += x[i] * y[i * ystride];
+            s1 += x[i + 1] * y[(i + 1) * ystride];
+            s2 += x[i + 2] * y[(i + 2) * ystride];
+            s3 += x[i + 3] * y[(i + 3) * ystride];
+        }
+        for (; i < n; i++)
+            s0 += x[i] * y[i * ystride];
+        dot = (s0 + s1) + (s2 + s3);
+        if (p_isinf(dot) == 0 && !p_isnan(dot))
+            return dot;
+        dot = 0;
+    #endif
+    for (int4 i = 0; i < n; i++)
+        dot += x[i] * y[i * ystride];
+    return dot;
+}
+
+/* Returns the sum of the squares of the elements, each scaled by 2^-scale
+ * (10^-scale in the decimal build), for FNRM.
+ */
+phloat sum_squares_phloat(const phloat *data, int4 n, int scale) {
+    phloat sum = 0;
+    #ifndef BCD_MATH
+        /* When 2^-scale is a normal number, multiplying by it gives
+         * exactly the same result as scalbn(), and it's a lot cheaper.
+         */
+        if (scale >= -1023 && scale <= 1022) {
+            double f = scalbn(1.0, -scale);
+            double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+            int4 i;
+            for (i = 0; i + 4 <= n; i += 4) {
+                double x0 = data[i] * f;
+                double x1 = data[i + 1] * f;
+                double x2 = data[i + 2] * f;
+                double x3 = data[i + 3] * f;
+                s0 += x0 * x0;
+                s1 += x1 * x1;
+                s2 += x2 * x2;
+                s3 += x3 * x3;
+            }
+            for (; i < n; i++) {
+                double x = data[i] * f;
+                s0 += x * x;
+            }
+            return (s0 + s1) + (s2 + s3);
+        }
+    #endif
+    for (int4 i = 0; i < n; i++) {
+        phloat x = scalbn(data[i], -scale);
+        sum += x * x;
+    }
+    return sum;
+}
+
 int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool check_matedit) {
     int idx = lookup_var(name, namelen);
     if (check_matedit
@@ -1424,6 +1556,22 @@ int dimension_array(const char *name, int namelen, int4 rows, int4 columns, bool
         return dimension_array_ref(matrix, rows, columns);
 }
 
+/* Matrix arrays that are grown in place get some room to spare, so that
+ * adding rows one at a time, with GROW in the matrix editor, J+, or INSR,
+ * takes amortized constant time instead of copying the whole matrix every
+ * time. Returns 'size' if the bigger capacity would not be addressable with
+ * a signed 32-bit byte count.
+ */
+static int4 grown_capacity(int4 capacity, int4 size, int esize) {
+    int4 newcap = capacity + capacity / 2;
+    if (newcap < size)
+        return size;
+    double d_bytes = ((double) newcap) * esize;
+    if (((double) (int4) d_bytes) != d_bytes)
+        return size;
+    return newcap;
+}
+
 int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
     int4 size = rows * columns;
     if (matrix->type == TYPE_REALMATRIX) {
@@ -1431,57 +1579,79 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
         if (oldmatrix->rows == rows && oldmatrix->columns == columns)
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
+            realmatrix_data *array = oldmatrix->array;
             int4 oldsize = oldmatrix->rows * oldmatrix->columns;
-            if (size == oldsize) {
-                /* Easy case! */
-                oldmatrix->rows = rows;
-                oldmatrix->columns = columns;
-                return ERR_NONE;
-            } else if (size < oldsize) {
-                /* Also pretty easy, shrinking means we don't have to worry
-                 * about allocation failures. We do deal with realloc()
-                 * failures, because technically, realloc() can fail even when
-                 * shrinking, but that is easy to handle by simply hanging onto
-                 * the existing block.
+            if (size <= oldsize) {
+                /* Shrinking never fails. Long strings that fall off the
+                 * end are reclaimed by trim_matrix_strings(), below. The
+                 * arrays are only reallocated if a lot of space would be
+                 * wasted otherwise. 'is_string' and 'data' must always
+                 * have the same capacity, so rather than realloc() each of
+                 * them, which could leave one shrunk and the other not, I
+                 * allocate both new blocks first, and only switch over if
+                 * both allocations succeed. If not, I simply hang onto the
+                 * existing blocks.
                  */
-                free_long_strings(oldmatrix->array->is_string + size, oldmatrix->array->data + size, oldsize - size);
-                char *new_is_string = (char *) realloc(oldmatrix->array->is_string, size);
-                if (new_is_string != NULL)
-                    oldmatrix->array->is_string = new_is_string;
-                phloat *new_data = (phloat *) realloc((void *) oldmatrix->array->data, size * sizeof(phloat));
-                if (new_data != NULL)
-                    oldmatrix->array->data = new_data;
-                oldmatrix->rows = rows;
-                oldmatrix->columns = columns;
-                return ERR_NONE;
-            }
-            /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc(). However, I
-             * only use realloc() on the 'data' array, not on the
-             * 'is_string' array -- if I used it on both, and the second
-             * call fails, I might be unable to roll back the first.
-             * So, playing safe -- shouldn't be too big a handicap since
-             * 'is_string' is a lot smaller than 'data', so the transient
-             * memory overhead is only about 12.5%.
-             */
-            char *new_is_string = (char *) malloc(size);
-            if (new_is_string == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            phloat *new_data = (phloat *) realloc((void *) oldmatrix->array->data, size * sizeof(phloat));
-            if (new_data == NULL) {
-                free(new_is_string);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            memcpy(new_is_string, oldmatrix->array->is_string, oldsize);
-            for (int4 i = oldsize; i < size; i++) {
-                new_is_string[i] = 0;
-                new_data[i] = 0;
+                array->string_count -= count_strings(array->is_string + size, oldsize - size);
+                if (size < array->capacity / 4) {
+                    char *new_is_string = (char *) malloc(size);
+                    phloat *new_data = (phloat *) malloc(size * sizeof(phloat));
+                    if (new_is_string != NULL && new_data != NULL) {
+                        memcpy(new_is_string, array->is_string, size);
+                        memcpy(new_data, array->data, size * sizeof(phloat));
+                        free(array->is_string);
+                        free(array->data);
+                        array->is_string = new_is_string;
+                        array->data = new_data;
+                        array->capacity = size;
+                    } else {
+                        free(new_is_string);
+                        free(new_data);
+                    }
+                }
+            } else {
+                if (size > array->capacity) {
+                    /* Since there are no shared references to this array,
+                     * I can modify it in place using a realloc(). However, I
+                     * only use realloc() on the 'data' array, not on the
+                     * 'is_string' array -- if I used it on both, and the
+                     * second call fails, I might be unable to roll back the
+                     * first. So, playing safe -- shouldn't be too big a
+                     * handicap since 'is_string' is a lot smaller than
+                     * 'data', so the transient memory overhead is only about
+                     * 12.5%. If there is no memory for spare capacity, we
+                     * try again without.
+                     */
+                    int4 newcap = grown_capacity(array->capacity, size, sizeof(phloat));
+                    char *new_is_string;
+                    phloat *new_data;
+                    while (true) {
+                        new_is_string = (char *) malloc(newcap);
+                        if (new_is_string != NULL) {
+                            new_data = (phloat *) realloc((void *) array->data, newcap * sizeof(phloat));
+                            if (new_data != NULL)
+                                break;
+                            free(new_is_string);
+                        }
+                        if (newcap == size)
+                            return ERR_INSUFFICIENT_MEMORY;
+                        newcap = size;
+                    }
+                    memcpy(new_is_string, array->is_string, oldsize);
+                    free(array->is_string);
+                    array->is_string = new_is_string;
+                    array->data = new_data;
+                    array->capacity = newcap;
+                }
+                for (int4 i = oldsize; i < size; i++) {
+                    array->is_string[i] = 0;
+                    array->data[i] = 0;
+                }
             }
-            free(oldmatrix->array->is_string);
-            oldmatrix->array->is_string = new_is_string;
-            oldmatrix->array->data = new_data;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
+            if (size < oldsize)
+                trim_matrix_strings(oldmatrix);
             return ERR_NONE;
         } else {
             /* There are shared references to the matrix. This means I
@@ -1502,7 +1672,6 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             }
             new_array->is_string = (char *) malloc(size);
             if (new_array->is_string == NULL) {
-                nomem:
                 free(new_array->data);
                 free(new_array);
                 return ERR_INSUFFICIENT_MEMORY;
@@ -1511,29 +1680,23 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             s = oldsize < size ? oldsize : size;
             for (i = 0; i < s; i++) {
                 new_array->is_string[i] = oldmatrix->array->is_string[i];
-                if (oldmatrix->array->is_string[i] == 2) {
-                    int4 *sp = *(int4 **) &oldmatrix->array->data[i];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_long_strings(new_array->is_string, new_array->data, i);
-                        free(new_array->is_string);
-                        goto nomem;
-                    }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &new_array->data[i] = dp;
-                } else {
-                    new_array->data[i] = oldmatrix->array->data[i];
-                }
+                new_array->data[i] = oldmatrix->array->data[i];
             }
             for (i = s; i < size; i++) {
                 new_array->is_string[i] = 0;
                 new_array->data[i] = 0;
             }
+            new_array->strings = NULL;
+            share_matrix_strings(new_array, oldmatrix->array);
+            new_array->string_count = count_strings(new_array->is_string, s);
+            new_array->capacity = size;
             new_array->refcount = 1;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
+            if (size < oldsize)
+                trim_matrix_strings(oldmatrix);
             return ERR_NONE;
         }
     } else if (matrix->type == TYPE_COMPLEXMATRIX) {
@@ -1542,17 +1705,39 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
             /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc().
+             * I can modify it in place using a realloc(). As with real
+             * matrices, there may be room to spare already, and shrinking
+             * only reallocates if a lot of space would be wasted.
              */
-            int4 i, oldsize;
-            phloat *new_data = (phloat *)
-                    realloc((void *) oldmatrix->array->data, 2 * size * sizeof(phloat));
-            if (new_data == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            oldsize = oldmatrix->rows * oldmatrix->columns;
-            for (i = 2 * oldsize; i < 2 * size; i++)
-                new_data[i] = 0;
-            oldmatrix->array->data = new_data;
+            complexmatrix_data *array = oldmatrix->array;
+            int4 oldsize = oldmatrix->rows * oldmatrix->columns;
+            if (size <= oldsize) {
+                if (size < array->capacity / 4) {
+                    phloat *new_data = (phloat *)
+                            realloc((void *) array->data, 2 * size * sizeof(phloat));
+                    if (new_data != NULL) {
+                        array->data = new_data;
+                        array->capacity = size;
+                    }
+                }
+            } else {
+                if (size > array->capacity) {
+                    int4 newcap = grown_capacity(array->capacity, size, 2 * sizeof(phloat));
+                    phloat *new_data = (phloat *)
+                            realloc((void *) array->data, 2 * newcap * sizeof(phloat));
+                    if (new_data == NULL && newcap > size) {
+                        newcap = size;
+                        new_data = (phloat *)
+                            realloc((void *) array->data, 2 * newcap * sizeof(phloat));
+                    }
+                    if (new_data == NULL)
+                        return ERR_INSUFFICIENT_MEMORY;
+                    array->data = new_data;
+                    array->capacity = newcap;
+                }
+                for (int4 i = 2 * oldsize; i < 2 * size; i++)
+                    array->data[i] = 0;
+            }
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
             return ERR_NONE;
@@ -1580,6 +1765,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 new_array->data[i] = oldmatrix->array->data[i];
             for (i = 2 * s; i < 2 * size; i++)
                 new_array->data[i] = 0;
+            new_array->capacity = size;
             new_array->refcount = 1;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
@@ -1597,6 +1783,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             /* Since there are no shared references to this array,
              * I can modify it in place using a realloc().
              */
+            invalidate_list_index(oldlist->array);
             if (oldlist->size > size) {
                 for (int4 i = size; i < oldlist->size; i++) {
                     free_vartype(oldlist->array->data[i]);
@@ -1656,6 +1843,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                     return ERR_INSUFFICIENT_MEMORY;
                 }
             }
+            new_array->index = NULL;
             new_array->refcount = 1;
             oldlist->array->refcount--;
             oldlist->array = new_array;
@@ -95,6 +95,11 @@ phloat sin_grad(phloat x);
 phloat cos_deg(phloat x);
 phloat cos_grad(phloat x);
 
+phloat sum_phloat(const phloat *data, int4 n, int4 stride);
+phloat sum_abs_phloat(const phloat *data, int4 n);
+phloat dot_phloat(const phloat *x, const phloat *y, int4 n, int4 ystride);
+phloat sum_squares_phloat(const phloat *data, int4 n, int scale);
+
 /***********************/
 /* Miscellaneous stuff */
 /***********************/
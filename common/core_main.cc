@@ -24,6 +24,7 @@
 #include "core_main.h"
 #include "core_commands2.h"
 #include "core_commands4.h"
+#include "core_commands5.h"
 #include "core_commands7.h"
 #include "core_display.h"
 #include "core_display.h"
@@ -173,6 +174,7 @@ void core_cleanup() {
     stack_capacity = 0;
     free_vartype(lastx);
     lastx = NULL;
+    clear_func_frames();
     purge_all_vars();
     clear_all_prgms();
     if (vars != NULL) {
@@ -1996,6 +1998,53 @@ static bool parse_number_line(char *buf, phloat *res) {
             return false;
     }
 
+    /* Fast path for plain numbers with at most 18 significant digits and
+     * a modest exponent; see parse_phloat(). Anything unusual, including
+     * zero, goes through the library instead.
+     */
+    int8 coeff = 0;
+    int sig_digits = 0;
+    int frac_digits = 0;
+    int exp = 0;
+    int exp_digits = 0;
+    bool neg = false;
+    bool neg_exp = false;
+    bool in_frac = false;
+    bool in_exp = false;
+    bool fast = true;
+    char *cp = buf;
+    if (*cp == '-' || *cp == '+')
+        neg = *cp++ == '-';
+    for (; fast && *cp != 0; cp++) {
+        char c = *cp;
+        if (c >= '0' && c <= '9') {
+            if (in_exp) {
+                exp = exp * 10 + c - '0';
+                if (++exp_digits > 4)
+                    fast = false;
+            } else {
+                if (in_frac)
+                    frac_digits++;
+                if (coeff != 0 || c != '0') {
+                    if (++sig_digits > 18)
+                        fast = false;
+                    else
+                        coeff = coeff * 10 + c - '0';
+                }
+            }
+        } else if (c == '.' && !in_frac && !in_exp) {
+            in_frac = true;
+        } else if (c == 'E' && !in_exp) {
+            in_exp = true;
+            if (cp[1] == '-' || cp[1] == '+')
+                neg_exp = *++cp == '-';
+        } else
+            fast = false;
+    }
+    if (fast && (!in_exp || exp_digits > 0)
+            && digits2phloat(neg, coeff, (neg_exp ? -exp : exp) - frac_digits, res))
+        return true;
+
 #ifdef BCD_MATH
     *res = Phloat(buf);
 #else
@@ -2871,6 +2920,62 @@ static bool parse_phloat(const char *p, int len, phloat *res, const char *format
         } else
             return false;
     }
+    char decimal, separator;
+    if (format == NULL) {
+        decimal = flags.f.decimal_point ? '.' : ',';
+        separator = flags.f.decimal_point ? ',' : '.';
+    } else {
+        decimal = format[0];
+        separator = format[1];
+    }
+    // Fast path: collect the coefficient and exponent in one pass, and
+    // build the phloat from those directly. This handles the bulk of what
+    // gets pasted or imported: numbers with at most 18 significant digits
+    // and a modest exponent. Anything else, including zero, goes through
+    // string2phloat() below.
+    int8 coeff = 0;
+    int sig_digits = 0;
+    int frac_digits = 0;
+    int exp = 0;
+    bool neg = false;
+    bool neg_exp = false;
+    bool in_frac = false;
+    bool in_exp = false;
+    int j = 0;
+    while (j < len) {
+        char c = p[j];
+        if (c >= '0' && c <= '9') {
+            if (in_exp) {
+                exp = exp * 10 + c - '0';
+                if (exp > 9999)
+                    break;
+            } else {
+                if (in_frac)
+                    frac_digits++;
+                if (coeff != 0 || c != '0') {
+                    if (++sig_digits > 18)
+                        break;
+                    coeff = coeff * 10 + c - '0';
+                }
+            }
+        } else if (c == '+' || c == ' ' || (c == separator && c != 0)) {
+            // Skip
+        } else if (c == '-') {
+            if (in_exp)
+                neg_exp = true;
+            else
+                neg = true;
+        } else if (c == decimal && !in_exp) {
+            in_frac = true;
+        } else if ((c == 'e' || c == 'E' || c == 24) && !in_exp) {
+            in_exp = true;
+        } else
+            break;
+        j++;
+    }
+    if (j == len && digits2phloat(neg, coeff, (neg_exp ? -exp : exp) - frac_digits, res))
+        return true;
+
     // We can't pass the string on to string2phloat() unchanged, because
     // that function is picky: it does not allow '+' signs, and it does
     // not allow the mantissa to be more than 34 or 16 digits long (including
@@ -2883,20 +2988,13 @@ static bool parse_phloat(const char *p, int len, phloat *res, const char *format
     bool in_mant = true;
     bool leading_zero = true;
     int exp_offset = 0;
-    int exp = 0;
-    bool neg_exp = false;
     int mant_digits = 0;
     bool in_int_mant = true;
     bool empty_mant = true;
-    int i = 0, j = 0;
-    char decimal, separator;
-    if (format == NULL) {
-        decimal = flags.f.decimal_point ? '.' : ',';
-        separator = flags.f.decimal_point ? ',' : '.';
-    } else {
-        decimal = format[0];
-        separator = format[1];
-    }
+    int i = 0;
+    exp = 0;
+    neg_exp = false;
+    j = 0;
     while (i < BSIZE - 1 && j < len) {
         char c = p[j++];
         if (c == 0)
@@ -4577,6 +4675,11 @@ void core_paste(const char *buf) {
                 redisplay();
                 return;
             }
+            // Long strings go into this arena, which is handed to the
+            // matrix once it is complete, along with the string count
+            realmatrix_data strs;
+            strs.strings = NULL;
+            strs.string_count = 0;
             int pos = 0;
             int spos = 0;
             int p = 0, row = 0, col = 0;
@@ -4602,7 +4705,7 @@ void core_paste(const char *buf) {
                                 is_string[p] = 0;
                                 break;
                             case TYPE_COMPLEX:
-                                free_long_strings(is_string, data, p);
+                                free_matrix_strings(&strs);
                                 for (int i = 0; i < p; i++)
                                     if (is_string[i] != 0)
                                         data[i] = 0;
@@ -4636,17 +4739,18 @@ void core_paste(const char *buf) {
                                     *text = slen;
                                     memcpy(text + 1, hpbuf, slen);
                                     is_string[p] = 1;
+                                    strs.string_count++;
                                 } else {
-                                    int4 *t = (int4 *) malloc(slen + 4);
+                                    int4 *t = new_matrix_string(&strs, slen);
                                     if (t == NULL) {
-                                        free_long_strings(is_string, data, p);
+                                        free_matrix_strings(&strs);
                                         free(is_string);
                                         goto nomem;
                                     }
-                                    *t = slen;
                                     memcpy(t + 1, hpbuf, slen);
                                     *(int4 **) &data[p] = t;
                                     is_string[p] = 2;
+                                    strs.string_count++;
                                 }
                                 break;
                         }
@@ -4699,7 +4803,7 @@ void core_paste(const char *buf) {
                 vartype_realmatrix *rm = (vartype_realmatrix *)
                                 malloc(sizeof(vartype_realmatrix));
                 if (rm == NULL) {
-                    free_long_strings(is_string, data, p);
+                    free_matrix_strings(&strs);
                     free(data);
                     free(is_string);
                     display_error(ERR_INSUFFICIENT_MEMORY);
@@ -4710,7 +4814,7 @@ void core_paste(const char *buf) {
                                 malloc(sizeof(realmatrix_data));
                 if (rm->array == NULL) {
                     free(rm);
-                    free_long_strings(is_string, data, p);
+                    free_matrix_strings(&strs);
                     free(data);
                     free(is_string);
                     display_error(ERR_INSUFFICIENT_MEMORY);
@@ -4722,6 +4826,9 @@ void core_paste(const char *buf) {
                 rm->columns = cols;
                 rm->array->data = data;
                 rm->array->is_string = is_string;
+                rm->array->strings = strs.strings;
+                rm->array->string_count = strs.string_count;
+                rm->array->capacity = rows * cols;
                 rm->array->refcount = 1;
                 v = (vartype *) rm;
             } else {
@@ -4746,6 +4853,7 @@ void core_paste(const char *buf) {
                 cm->rows = rows;
                 cm->columns = cols;
                 cm->array->data = data;
+                cm->array->capacity = rows * cols;
                 cm->array->refcount = 1;
                 v = (vartype *) cm;
             }
@@ -4767,6 +4875,149 @@ void core_paste(const char *buf) {
     redisplay();
 }
 
+/* Parses one line of a statistics import file: one or two numbers, using '.'
+ * as the decimal point, separated by a comma, a semicolon, tabs, or spaces.
+ * A missing y is taken to be zero, as with Σ+ on a one-level stack. The line
+ * must be NUL-terminated, since scan_number() may look one character past
+ * the end. Returns false for lines that don't match, like column headers.
+ */
+static bool parse_sigma_line(const char *line, int len, phloat *x, phloat *y) {
+    int i = 0;
+    while (i < len && (line[i] == ' ' || line[i] == '\t'))
+        i++;
+    int s1 = i;
+    i = scan_number(line, len, i, ".", true);
+    int e1 = i;
+    if (e1 == s1)
+        return false;
+    while (i < len && (line[i] == ' ' || line[i] == '\t'))
+        i++;
+    if (i < len && (line[i] == ',' || line[i] == ';')) {
+        i++;
+        while (i < len && (line[i] == ' ' || line[i] == '\t'))
+            i++;
+    }
+    int s2 = i;
+    i = scan_number(line, len, i, ".", true);
+    int e2 = i;
+    while (i < len && (line[i] == ' ' || line[i] == '\t' || line[i] == ','))
+        i++;
+    if (i != len)
+        return false;
+    if (!parse_phloat(line + s1, e1 - s1, x, "."))
+        return false;
+    if (e2 == s2)
+        *y = 0;
+    else if (!parse_phloat(line + s2, e2 - s2, y, "."))
+        return false;
+    return true;
+}
+
+#define SIGMA_IMPORT_BUFSIZE 65536
+#define SIGMA_IMPORT_PAIRS 1024
+
+void core_import_sigma(const char *csv_file_name) {
+    if (mode_interruptible != NULL)
+        stop_interruptible();
+    set_running(false);
+
+    FILE *f = my_fopen(csv_file_name, "rb");
+    if (f == NULL) {
+        char msg[1024];
+        int err = errno;
+        snprintf(msg, 1024, "Could not open \"%s\" for reading: %s (%d)", csv_file_name, strerror(err), err);
+        shell_message(msg);
+        return;
+    }
+    char *buf = (char *) malloc(SIGMA_IMPORT_BUFSIZE + 1);
+    phloat *pairs = (phloat *) malloc(SIGMA_IMPORT_PAIRS * 2 * sizeof(phloat));
+    if (buf == NULL || pairs == NULL) {
+        free(buf);
+        free(pairs);
+        fclose(f);
+        shell_message("Insufficient memory for statistics import.");
+        return;
+    }
+
+    int err = ERR_NONE;
+    int npairs = 0;
+    int4 lineno = 0;
+    int4 skipped = 0;
+    int have = 0;
+    bool discard = false;
+    while (err == ERR_NONE) {
+        int n = (int) fread(buf + have, 1, SIGMA_IMPORT_BUFSIZE - have, f);
+        int total = have + n;
+        bool eof = n == 0;
+        int start = 0;
+        while (err == ERR_NONE && start < total) {
+            char *nl = (char *) memchr(buf + start, '\n', total - start);
+            int end;
+            if (nl != NULL)
+                end = (int) (nl - buf);
+            else if (eof)
+                end = total;
+            else
+                break;
+            int len = end - start;
+            if (discard) {
+                // Tail end of an overlong line
+                discard = false;
+            } else {
+                if (len > 0 && buf[start + len - 1] == '\r')
+                    len--;
+                buf[start + len] = 0;
+                lineno++;
+                phloat x, y;
+                if (len == 0) {
+                    // Blank lines are OK
+                } else if (parse_sigma_line(buf + start, len, &x, &y)) {
+                    pairs[npairs * 2] = x;
+                    pairs[npairs * 2 + 1] = y;
+                    if (++npairs == SIGMA_IMPORT_PAIRS) {
+                        err = sigma_add_pairs(pairs, npairs);
+                        npairs = 0;
+                    }
+                } else if (lineno > 1) {
+                    // The first line is allowed to be a header
+                    skipped++;
+                }
+            }
+            start = end + 1;
+        }
+        if (eof || err != ERR_NONE)
+            break;
+        have = total - start;
+        if (have == SIGMA_IMPORT_BUFSIZE) {
+            // No newline in a full buffer; skip the rest of this line
+            if (!discard) {
+                lineno++;
+                skipped++;
+                discard = true;
+            }
+            have = 0;
+        } else if (have > 0)
+            memmove(buf, buf + start, have);
+    }
+    if (err == ERR_NONE && npairs > 0)
+        err = sigma_add_pairs(pairs, npairs);
+
+    if (err != ERR_NONE) {
+        char msg[100];
+        snprintf(msg, 100, "Statistics import failed: %.*s", errors[err].length, errors[err].text);
+        shell_message(msg);
+    } else if (ferror(f))
+        shell_message("An error occurred during statistics import.");
+    else if (skipped > 0) {
+        char msg[100];
+        snprintf(msg, 100, "Statistics import skipped %d invalid line%s.", skipped, skipped == 1 ? "" : "s");
+        shell_message(msg);
+    }
+    free(buf);
+    free(pairs);
+    fclose(f);
+}
+
 #if defined(ANDROID) || defined(IPHONE)
 
 void core_get_char_pixels(const char *ch, char *pixels) {
@@ -4986,37 +5237,103 @@ static synonym_spec hp41_synonyms[] =
     { "",       true,  0, CMD_NONE    }
 };
 
-int find_builtin(const char *name, int namelen) {
-    for (int i = 0; hp41_synonyms[i].cmd_id != CMD_NONE; i++) {
-        if (namelen != hp41_synonyms[i].namelen)
-            continue;
-        for (int j = 0; j < namelen; j++)
-            if (name[j] != hp41_synonyms[i].name[j])
-                goto nomatch1;
-        return hp41_synonyms[i].cmd_id;
-        nomatch1:;
+/* Hash index for find_builtin(). Names are hashed after the same character
+ * normalization find_builtin() applies when comparing, with '\17' folded
+ * into '-', so the HP-41 synonyms, the exact matches, and the fuzzy '-'/'\17'
+ * matches for a given name all end up in the same chain. The chains list the
+ * synonyms first, followed by the commands in cmd_array order, so a lookup
+ * only has to compare the handful of candidates in one chain, in the same
+ * order as a linear scan would.
+ * The index is built on the first lookup; cmd_array never changes.
+ */
+
+#define BUILTIN_HASH_SIZE 1024
+
+struct builtin_index_entry {
+    int2 id; // cmd_array index, or -1 - hp41_synonyms index
+    int2 next;
+};
+
+static int2 builtin_hash[BUILTIN_HASH_SIZE];
+static builtin_index_entry builtin_entries[CMD_SENTINEL + sizeof(hp41_synonyms) / sizeof(synonym_spec)];
+static bool builtin_index_built = false;
+
+static inline unsigned char normalize_builtin_char(unsigned char c) {
+    if (undefined_char(c))
+        c &= 127;
+    else if (c == 30)
+        c = 94;
+    return c;
+}
+
+static int builtin_hash_code(const char *name, int namelen) {
+    uint4 h = 2166136261U;
+    for (int i = 0; i < namelen; i++) {
+        unsigned char c = normalize_builtin_char(name[i]);
+        if (c == '\17')
+            c = '-';
+        h = (h ^ c) * 16777619U;
     }
+    return (h ^ namelen) & (BUILTIN_HASH_SIZE - 1);
+}
 
-    int fuzzy_match = CMD_NONE;
+static void add_builtin_index_entry(int id, const char *name, int namelen, int *n) {
+    int h = builtin_hash_code(name, namelen);
+    builtin_entries[*n].id = id;
+    builtin_entries[*n].next = -1;
+    // Append, to keep each chain in table order
+    if (builtin_hash[h] == -1)
+        builtin_hash[h] = *n;
+    else {
+        int e = builtin_hash[h];
+        while (builtin_entries[e].next != -1)
+            e = builtin_entries[e].next;
+        builtin_entries[e].next = *n;
+    }
+    (*n)++;
+}
 
+static void build_builtin_index() {
+    for (int i = 0; i < BUILTIN_HASH_SIZE; i++)
+        builtin_hash[i] = -1;
+    int n = 0;
+    for (int i = 0; hp41_synonyms[i].cmd_id != CMD_NONE; i++)
+        add_builtin_index_entry(-1 - i, hp41_synonyms[i].name, hp41_synonyms[i].namelen, &n);
     for (int i = 0; i < CMD_SENTINEL; i++) {
         if ((cmd_array[i].flags & FLAG_HIDDEN) != 0)
             continue;
+        add_builtin_index_entry(i, cmd_array[i].name, cmd_array[i].name_length, &n);
+    }
+    builtin_index_built = true;
+}
+
+int find_builtin(const char *name, int namelen) {
+    if (!builtin_index_built)
+        build_builtin_index();
+
+    int fuzzy_match = CMD_NONE;
+
+    for (int e = builtin_hash[builtin_hash_code(name, namelen)]; e != -1; e = builtin_entries[e].next) {
+        int i = builtin_entries[e].id;
+        if (i < 0) {
+            const synonym_spec *syn = hp41_synonyms + (-1 - i);
+            if (namelen != syn->namelen)
+                continue;
+            for (int j = 0; j < namelen; j++)
+                if (name[j] != syn->name[j])
+                    goto nomatch1;
+            return syn->cmd_id;
+            nomatch1:
+            continue;
+        }
+
         if (cmd_array[i].name_length != namelen)
             continue;
         bool exact = true;
         for (int j = 0; j < namelen; j++) {
             unsigned char c1, c2;
-            c1 = name[j];
-            if (undefined_char(c1))
-                c1 &= 127;
-            else if (c1 == 30)
-                c1 = 94;
-            c2 = cmd_array[i].name[j];
-            if (undefined_char(c2))
-                c2 &= 127;
-            else if (c2 == 30)
-                c2 = 94;
+            c1 = normalize_builtin_char(name[j]);
+            c2 = normalize_builtin_char(cmd_array[i].name[j]);
             if (c1 != c2)
                 if (c1 == '-' && c2 == '\17')
                     exact = false;
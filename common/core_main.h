@@ -310,6 +310,18 @@ char *core_copy();
  */
 void core_paste(const char *s);
 
+/* core_import_sigma()
+ *
+ * Reads (x, y) pairs from the text file named by csv_file_name, one pair per
+ * line, and adds them to the summation registers, as if by Σ+, without
+ * touching the stack. The values use '.' as the decimal point, and are
+ * separated by a comma, a semicolon, tabs, or spaces; a line with only one
+ * value has y = 0. The first line may be a column header. The file is read
+ * in chunks, so there is no limit on the number of observations.
+ * Errors are reported using shell_message().
+ */
+void core_import_sigma(const char *csv_file_name);
+
 #if defined(ANDROID) || defined(IPHONE)
 
 /* core_get_char_pixels()
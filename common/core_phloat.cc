@@ -141,6 +141,136 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
     return 0;
 }
 
+/* Fast paths for exact arithmetic. Programs spend much of their time adding,
+ * subtracting, multiplying, and comparing small integers and short decimals,
+ * like loop counters and ISG/DSE control numbers. For those, the exact result
+ * can be computed with 64-bit integer math, and since an exact result has to
+ * have the preferred exponent, it is bit for bit what the library would
+ * return; so we skip the library, and its global rounding and flag state.
+ * Only finite operands with coefficients below 2^62 are handled this way;
+ * anything else falls back on the library. So do sums and products that are
+ * zero, to leave the rules for the sign of zero to the library.
+ */
+
+#define BID_EXP_BIAS 6176
+#define BID_MAX_EXP 12287
+#define SMALL_COEFF_LIMIT 0x4000000000000000LL
+
+static const int8 pow10_int8[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+    100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+    1000000000000LL, 10000000000000LL, 100000000000000LL,
+    1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+    1000000000000000000LL
+};
+
+/* Decodes a BID128 value with a coefficient below 2^62 into a signed
+ * coefficient and a biased exponent. Infinities, NaNs, and values in the
+ * encoding for large coefficients are rejected.
+ */
+static bool small_decimal(const BID_UINT128 *v, int8 *coeff, int *exp) {
+    uint8 hi = v->w[BID_HIGH_128W];
+    uint8 lo = v->w[BID_LOW_128W];
+    if ((hi & 0x6000000000000000ULL) == 0x6000000000000000ULL
+            || (hi & 0x0001ffffffffffffULL) != 0
+            || lo >= (uint8) SMALL_COEFF_LIMIT)
+        return false;
+    *exp = (int) ((hi >> 49) & 0x3fff);
+    *coeff = (hi >> 63) != 0 ? -(int8) lo : (int8) lo;
+    return true;
+}
+
+static void make_decimal(BID_UINT128 *v, int8 coeff, int exp) {
+    uint8 hi = ((uint8) exp) << 49;
+    if (coeff < 0) {
+        hi |= 0x8000000000000000ULL;
+        coeff = -coeff;
+    }
+    v->w[BID_HIGH_128W] = hi;
+    v->w[BID_LOW_128W] = (uint8) coeff;
+}
+
+/* Converts sign, coefficient, and decimal exponent, as collected by a
+ * number parser, straight to a phloat, skipping the string formatting and
+ * parsing done by string2phloat(). The result is bit for bit what
+ * bid128_from_string() would return for the same digits: the coefficient
+ * is kept as is, not normalized. Returns false for zero, and for exponents
+ * that would need rounding or clamping; callers fall back on
+ * string2phloat() for those.
+ */
+bool digits2phloat(bool neg, int8 coeff, int exp, phloat *d) {
+    if (coeff <= 0 || coeff >= SMALL_COEFF_LIMIT)
+        return false;
+    exp += BID_EXP_BIAS;
+    if (exp < 0 || exp > BID_MAX_EXP)
+        return false;
+    BID_UINT128 b;
+    make_decimal(&b, neg ? -coeff : coeff, exp);
+    *d = b;
+    return true;
+}
+
+/* Brings two small decimals to the smaller of their exponents, by scaling
+ * up the coefficient of the other one. Fails if that coefficient would no
+ * longer be small.
+ */
+static bool align_decimals(int8 *c1, int *e1, int8 *c2, int *e2) {
+    if (*e1 < *e2)
+        return align_decimals(c2, e2, c1, e1);
+    int d = *e1 - *e2;
+    if (d == 0)
+        return true;
+    if (d > 18)
+        return false;
+    int8 limit = (SMALL_COEFF_LIMIT - 1) / pow10_int8[d];
+    if (*c1 > limit || *c1 < -limit)
+        return false;
+    *c1 *= pow10_int8[d];
+    *e1 = *e2;
+    return true;
+}
+
+static bool fast_add(const BID_UINT128 *x, const BID_UINT128 *y, bool sub, BID_UINT128 *res) {
+    int8 c1, c2;
+    int e1, e2;
+    if (!small_decimal(x, &c1, &e1) || !small_decimal(y, &c2, &e2)
+            || !align_decimals(&c1, &e1, &c2, &e2))
+        return false;
+    // Both are below 2^62 in magnitude, so this can't overflow
+    int8 c = sub ? c1 - c2 : c1 + c2;
+    if (c == 0)
+        return false;
+    make_decimal(res, c, e1);
+    return true;
+}
+
+static bool fast_mul(const BID_UINT128 *x, const BID_UINT128 *y, BID_UINT128 *res) {
+    int8 c1, c2;
+    int e1, e2;
+    if (!small_decimal(x, &c1, &e1) || !small_decimal(y, &c2, &e2))
+        return false;
+    if (c1 == 0 || c2 == 0
+            || c1 >= 0x80000000LL || c1 <= -0x80000000LL
+            || c2 >= 0x80000000LL || c2 <= -0x80000000LL)
+        return false;
+    int e = e1 + e2 - BID_EXP_BIAS;
+    if (e < 0 || e > BID_MAX_EXP)
+        return false;
+    make_decimal(res, c1 * c2, e);
+    return true;
+}
+
+/* Sets *cmp to -1, 0, or 1, for x < y, x == y, or x > y */
+static bool fast_compare(const BID_UINT128 *x, const BID_UINT128 *y, int *cmp) {
+    int8 c1, c2;
+    int e1, e2;
+    if (!small_decimal(x, &c1, &e1) || !small_decimal(y, &c2, &e2)
+            || !align_decimals(&c1, &e1, &c2, &e2))
+        return false;
+    *cmp = c1 < c2 ? -1 : c1 > c2 ? 1 : 0;
+    return true;
+}
+
 /* public */
 Phloat::Phloat(const char *str) {
     bid128_from_string(&val, (char *) str);
@@ -164,7 +294,7 @@ Phloat::Phloat(int8 numer, int8 denom) {
 
 /* public */
 Phloat::Phloat(int i) {
-    bid128_from_int32(&val, &i);
+    make_decimal(&val, i, BID_EXP_BIAS);
 }
 
 /* public */
@@ -191,7 +321,7 @@ Phloat::Phloat(const Phloat &p) {
 
 /* public */
 Phloat Phloat::operator=(int i) {
-    bid128_from_int32(&val, &i);
+    make_decimal(&val, i, BID_EXP_BIAS);
     return *this;
 }
 
@@ -237,42 +367,54 @@ void Phloat::assign17digits(double d) {
 
 /* public */
 bool Phloat::operator==(Phloat p) const {
-    int r;
+    int r, cmp;
+    if (fast_compare(&val, &p.val, &cmp))
+        return cmp == 0;
     bid128_quiet_equal(&r, (BID_UINT128 *) &val, &p.val);
     return r != 0;
 }
 
 /* public */
 bool Phloat::operator!=(Phloat p) const {
-    int r;
+    int r, cmp;
+    if (fast_compare(&val, &p.val, &cmp))
+        return cmp != 0;
     bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, &p.val);
     return r != 0;
 }
 
 /* public */
 bool Phloat::operator<(Phloat p) const {
-    int r;
+    int r, cmp;
+    if (fast_compare(&val, &p.val, &cmp))
+        return cmp < 0;
     bid128_quiet_less(&r, (BID_UINT128 *) &val, &p.val);
     return r != 0;
 }
 
 /* public */
 bool Phloat::operator<=(Phloat p) const {
-    int r;
+    int r, cmp;
+    if (fast_compare(&val, &p.val, &cmp))
+        return cmp <= 0;
     bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, &p.val);
     return r != 0;
 }
 
 /* public */
 bool Phloat::operator>(Phloat p) const {
-    int r;
+    int r, cmp;
+    if (fast_compare(&val, &p.val, &cmp))
+        return cmp > 0;
     bid128_quiet_greater(&r, (BID_UINT128 *) &val, &p.val);
     return r != 0;
 }
 
 /* public */
 bool Phloat::operator>=(Phloat p) const {
-    int r;
+    int r, cmp;
+    if (fast_compare(&val, &p.val, &cmp))
+        return cmp >= 0;
     bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, &p.val);
     return r != 0;
 }
@@ -287,7 +429,8 @@ Phloat Phloat::operator-() const {
 /* public */
 Phloat Phloat::operator*(Phloat p) const {
     BID_UINT128 res;
-    bid128_mul(&res, (BID_UINT128 *) &val, &p.val);
+    if (!fast_mul(&val, &p.val, &res))
+        bid128_mul(&res, (BID_UINT128 *) &val, &p.val);
     return Phloat(res);
 }
 
@@ -301,21 +444,24 @@ Phloat Phloat::operator/(Phloat p) const {
 /* public */
 Phloat Phloat::operator+(Phloat p) const {
     BID_UINT128 res;
-    bid128_add(&res, (BID_UINT128 *) &val, &p.val);
+    if (!fast_add(&val, &p.val, false, &res))
+        bid128_add(&res, (BID_UINT128 *) &val, &p.val);
     return Phloat(res);
 }
 
 /* public */
 Phloat Phloat::operator-(Phloat p) const {
     BID_UINT128 res;
-    bid128_sub(&res, (BID_UINT128 *) &val, &p.val);
+    if (!fast_add(&val, &p.val, true, &res))
+        bid128_sub(&res, (BID_UINT128 *) &val, &p.val);
     return Phloat(res);
 }
 
 /* public */
 Phloat Phloat::operator*=(Phloat p) {
     BID_UINT128 res;
-    bid128_mul(&res, &val, &p.val);
+    if (!fast_mul(&val, &p.val, &res))
+        bid128_mul(&res, &val, &p.val);
     val = res;
     return *this;
 }
@@ -331,7 +477,8 @@ Phloat Phloat::operator/=(Phloat p) {
 /* public */
 Phloat Phloat::operator+=(Phloat p) {
     BID_UINT128 res;
-    bid128_add(&res, &val, &p.val);
+    if (!fast_add(&val, &p.val, false, &res))
+        bid128_add(&res, &val, &p.val);
     val = res;
     return *this;
 }
@@ -339,7 +486,8 @@ Phloat Phloat::operator+=(Phloat p) {
 /* public */
 Phloat Phloat::operator-=(Phloat p) {
     BID_UINT128 res;
-    bid128_sub(&res, &val, &p.val);
+    if (!fast_add(&val, &p.val, true, &res))
+        bid128_sub(&res, &val, &p.val);
     val = res;
     return *this;
 }
@@ -348,10 +496,10 @@ Phloat Phloat::operator-=(Phloat p) {
 Phloat Phloat::operator++() {
     // prefix
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
+    make_decimal(&one, 1, BID_EXP_BIAS);
     BID_UINT128 temp;
-    bid128_add(&temp, &val, &one);
+    if (!fast_add(&val, &one, false, &temp))
+        bid128_add(&temp, &val, &one);
     val = temp;
     return *this;
 }
@@ -361,9 +509,9 @@ Phloat Phloat::operator++(int) {
     // postfix
     Phloat old = *this;
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_add(&val, &old.val, &one);
+    make_decimal(&one, 1, BID_EXP_BIAS);
+    if (!fast_add(&old.val, &one, false, &val))
+        bid128_add(&val, &old.val, &one);
     return old;
 }
 
@@ -371,10 +519,10 @@ Phloat Phloat::operator++(int) {
 Phloat Phloat::operator--() {
     // prefix
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
+    make_decimal(&one, 1, BID_EXP_BIAS);
     BID_UINT128 temp;
-    bid128_sub(&temp, &val, &one);
+    if (!fast_add(&val, &one, true, &temp))
+        bid128_sub(&temp, &val, &one);
     val = temp;
     return *this;
 }
@@ -384,9 +532,9 @@ Phloat Phloat::operator--(int) {
     // postfix
     Phloat old = *this;
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_sub(&val, &old.val, &one);
+    make_decimal(&one, 1, BID_EXP_BIAS);
+    if (!fast_add(&old.val, &one, true, &val))
+        bid128_sub(&val, &old.val, &one);
     return old;
 }
 
@@ -772,8 +920,9 @@ Phloat copysign(Phloat x, Phloat y) {
 
 Phloat operator*(int x, Phloat y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_mul(&res, &xx, &y.val);
+    make_decimal(&xx, x, BID_EXP_BIAS);
+    if (!fast_mul(&xx, &y.val, &res))
+        bid128_mul(&res, &xx, &y.val);
     return Phloat(res);
 }
 
@@ -795,22 +944,26 @@ Phloat operator/(double x, Phloat y) {
 
 Phloat operator+(int x, Phloat y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_add(&res, &xx, &y.val);
+    make_decimal(&xx, x, BID_EXP_BIAS);
+    if (!fast_add(&xx, &y.val, false, &res))
+        bid128_add(&res, &xx, &y.val);
     return Phloat(res);
 }
 
 Phloat operator-(int x, Phloat y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_sub(&res, &xx, &y.val);
+    make_decimal(&xx, x, BID_EXP_BIAS);
+    if (!fast_add(&xx, &y.val, true, &res))
+        bid128_sub(&res, &xx, &y.val);
     return Phloat(res);
 }
 
 bool operator==(int4 x, Phloat y) {
     BID_UINT128 xx;
-    bid128_from_int32(&xx, &x);
-    int r;
+    make_decimal(&xx, x, BID_EXP_BIAS);
+    int r, cmp;
+    if (fast_compare(&xx, &y.val, &cmp))
+        return cmp == 0;
     bid128_quiet_equal(&r, &xx, &y.val);
     return r != 0;
 }
@@ -964,6 +1117,29 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
     return 0;
 }
 
+/* Converts sign, coefficient, and decimal exponent, as collected by a
+ * number parser, straight to a phloat. When the coefficient and 10^|exp|
+ * are both exact doubles, a single multiplication or division gives the
+ * correctly rounded result, which is what the sscanf() in string2phloat()
+ * would return too. Returns false in all other cases; callers fall back
+ * on string2phloat() for those.
+ */
+bool digits2phloat(bool neg, int8 coeff, int exp, phloat *d) {
+    static const double pow10_exact[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if (coeff <= 0 || coeff > 0x20000000000000LL || exp < -22 || exp > 22)
+        return false;
+    double res = (double) coeff;
+    if (exp < 0)
+        res /= pow10_exact[-exp];
+    else
+        res *= pow10_exact[exp];
+    *d = neg ? -res : res;
+    return true;
+}
+
 double decimal2double(void *data, bool pin_magnitude /* = false */) {
     double res;
     BID_UINT128 *b, b2;
@@ -191,6 +191,7 @@ int phloat2string(phloat d, char *buf, int buflen,
                   int thousandssep, int max_mant_digits = 12,
                   const char *format = NULL);
 int string2phloat(const char *buf, int buflen, phloat *d);
+bool digits2phloat(bool neg, int8 coeff, int exp, phloat *d);
 
 
 #endif
@@ -228,10 +228,7 @@ int generic_sto(arg_struct *arg, char operation) {
                     if (!disentangle((vartype *) rm))
                         return ERR_INSUFFICIENT_MEMORY;
                     if (operation == 0) {
-                        if (rm->array->is_string[num] == 2)
-                            free(*(void **) &rm->array->data[num]);
-                        rm->array->data[num] = ((vartype_real *) stack[sp])->x;
-                        rm->array->is_string[num] = 0;
+                        put_matrix_real(rm, num, ((vartype_real *) stack[sp])->x);
                     } else {
                         phloat x, n;
                         int inf;
@@ -556,6 +556,11 @@ const command_spec cmd_array[] =
     /* For Plus42 Compatibility */
     { /* WIDTH */       docmd_width,       "WIDTH",               0x00, 0x00, 0xa2, 0x72,  5, ARG_NONE,   0, NA_T },
     { /* HEIGHT */      docmd_height,      "HEIGHT",              0x00, 0x00, 0xa2, 0x73,  6, ARG_NONE,   0, NA_T },
+
+    /* Sorting */
+    { /* SORT */        docmd_sort,        "SORT",                0x00, 0x00, 0xa7, 0xfc,  4, ARG_NONE,   1, 0x24 },
+    { /* SORTD */       docmd_sortd,       "SORTD",               0x00, 0x00, 0xa7, 0xfd,  5, ARG_NONE,   1, 0x24 },
+    { /* ORDER */       docmd_order,       "ORDER",               0x00, 0x00, 0xa7, 0xfe,  5, ARG_NONE,   1, 0x24 },
 };
 
 /*
@@ -922,6 +927,17 @@ XROM         A[0-7] nn (bits 2-0 of byte 1 plus bits 7-6 of byte 2 are the ROM
 ===============================================================================
 */
 
+/* Type bit for each TYPE_*, as used in rttypes */
+static const unsigned char type_bit[] = {
+    0,                         /* TYPE_NULL */
+    1 << (TYPE_REAL - 1),
+    1 << (TYPE_COMPLEX - 1),
+    1 << (TYPE_REALMATRIX - 1),
+    1 << (TYPE_COMPLEXMATRIX - 1),
+    1 << (TYPE_STRING - 1),
+    1 << (TYPE_LIST - 1)
+};
+
 int handle(int cmd, arg_struct *arg) {
     const command_spec *cs = cmd_array + cmd;
     if (flags.f.big_stack) {
@@ -938,6 +954,28 @@ int handle(int cmd, arg_struct *arg) {
         // that is left up to the functions that use it themselves.
         int argcount = cs->argcount;
         int rttypes = cs->rttypes;
+        // Combine the type bits of all the arguments and check them against
+        // rttypes with a single test. Only if that fails do we go over the
+        // arguments one by one, to find out which error to report.
+        int types;
+        switch (argcount) {
+            case 1:
+                types = type_bit[stack[sp]->type];
+                break;
+            case 2:
+                types = type_bit[stack[sp]->type]
+                      | type_bit[stack[sp - 1]->type];
+                break;
+            case 3:
+                types = type_bit[stack[sp]->type]
+                      | type_bit[stack[sp - 1]->type]
+                      | type_bit[stack[sp - 2]->type];
+                break;
+            default:
+                types = -1;
+        }
+        if ((types & ~rttypes) == 0)
+            return cs->handler(arg);
         for (int i = 0; i < argcount; i++) {
             int type = 1 << (stack[sp - i]->type - 1);
             if ((type & rttypes) == 0)
@@ -523,7 +523,11 @@
 #define CMD_WIDTH       473
 #define CMD_HEIGHT      474
 
-#define CMD_SENTINEL    475
+#define CMD_SORT        475
+#define CMD_SORTD       476
+#define CMD_ORDER       477
+
+#define CMD_SENTINEL    478
 
 
 /* command_spec.argtype */
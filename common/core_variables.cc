@@ -25,15 +25,19 @@
 
 
 // We cache vartype_real, vartype_complex, and vartype_string instances, to
-// cut down on the malloc/free overhead.
+// cut down on the malloc/free overhead. For lists, we cache the vartype_list
+// together with its list_data, but not the data array, whose size varies;
+// this mostly helps FUNC, which creates two small lists on every call.
 
 #define POOLSIZE 10
 static vartype_real *realpool[POOLSIZE];
 static vartype_complex *complexpool[POOLSIZE];
 static vartype_string *stringpool[POOLSIZE];
+static vartype_list *listpool[POOLSIZE];
 static int realpool_size = 0;
 static int complexpool_size = 0;
 static int stringpool_size = 0;
+static int listpool_size = 0;
 
 vartype *new_real(phloat value) {
     vartype_real *r;
@@ -84,13 +88,38 @@ vartype *new_string(const char *text, int length) {
         s->type = TYPE_STRING;
     }
     s->length = length;
-    if (length > SSLENV)
+    if (length > SSLENV) {
         s->t.ptr = dbuf;
+        s->capacity = length;
+    }
     if (text != NULL)
         memcpy(length > SSLENV ? s->t.ptr : s->t.buf, text, length);
     return (vartype *) s;
 }
 
+/* Makes sure that a long string has room for 'length' characters, without
+ * changing its contents or length. The buffer grows by half again its size
+ * at a time, so that extending a string repeatedly, as APPEND in a loop
+ * does, takes linear rather than quadratic time.
+ */
+bool reserve_string(vartype_string *s, int4 length) {
+    if (length <= s->capacity)
+        return true;
+    int4 newcap = s->capacity + s->capacity / 2;
+    if (newcap < length || newcap < s->capacity)
+        newcap = length;
+    char *p = (char *) realloc(s->t.ptr, newcap);
+    if (p == NULL && newcap > length) {
+        newcap = length;
+        p = (char *) realloc(s->t.ptr, newcap);
+    }
+    if (p == NULL)
+        return false;
+    s->t.ptr = p;
+    s->capacity = newcap;
+    return true;
+}
+
 vartype *new_realmatrix(int4 rows, int4 columns) {
     double d_bytes = ((double) rows) * ((double) columns) * sizeof(phloat);
     if (((double) (int4) d_bytes) != d_bytes)
@@ -126,6 +155,9 @@ vartype *new_realmatrix(int4 rows, int4 columns) {
     for (i = 0; i < sz; i++)
         rm->array->data[i] = 0;
     memset(rm->array->is_string, 0, sz);
+    rm->array->strings = NULL;
+    rm->array->string_count = 0;
+    rm->array->capacity = sz;
     rm->array->refcount = 1;
     return (vartype *) rm;
 }
@@ -157,28 +189,39 @@ vartype *new_complexmatrix(int4 rows, int4 columns) {
     }
     for (i = 0; i < sz; i++)
         cm->array->data[i] = 0;
+    cm->array->capacity = rows * columns;
     cm->array->refcount = 1;
     return (vartype *) cm;
 }
 
 vartype *new_list(int4 size) {
-    vartype_list *list = (vartype_list *) malloc(sizeof(vartype_list));
-    if (list == NULL)
-        return NULL;
-    list->type = TYPE_LIST;
-    list->size = size;
-    list->array = (list_data *) malloc(sizeof(list_data));
-    if (list->array == NULL) {
-        free(list);
-        return NULL;
+    vartype_list *list;
+    if (listpool_size > 0) {
+        list = listpool[--listpool_size];
+    } else {
+        list = (vartype_list *) malloc(sizeof(vartype_list));
+        if (list == NULL)
+            return NULL;
+        list->type = TYPE_LIST;
+        list->array = (list_data *) malloc(sizeof(list_data));
+        if (list->array == NULL) {
+            free(list);
+            return NULL;
+        }
     }
+    list->size = size;
     list->array->data = (vartype **) malloc(size * sizeof(vartype *));
     if (list->array->data == NULL && size != 0) {
-        free(list->array);
-        free(list);
+        if (listpool_size < POOLSIZE) {
+            listpool[listpool_size++] = list;
+        } else {
+            free(list->array);
+            free(list);
+        }
         return NULL;
     }
     memset(list->array->data, 0, size * sizeof(vartype *));
+    list->array->index = NULL;
     list->array->refcount = 1;
     return (vartype *) list;
 }
@@ -214,8 +257,7 @@ void free_vartype(vartype *v) {
         case TYPE_REALMATRIX: {
             vartype_realmatrix *rm = (vartype_realmatrix *) v;
             if (--(rm->array->refcount) == 0) {
-                int4 sz = rm->rows * rm->columns;
-                free_long_strings(rm->array->is_string, rm->array->data, sz);
+                free_matrix_strings(rm->array);
                 free(rm->array->data);
                 free(rm->array->is_string);
                 free(rm->array);
@@ -238,6 +280,11 @@ void free_vartype(vartype *v) {
                 for (int4 i = 0; i < list->size; i++)
                     free_vartype(list->array->data[i]);
                 free(list->array->data);
+                free(list->array->index);
+                if (listpool_size < POOLSIZE) {
+                    listpool[listpool_size++] = list;
+                    break;
+                }
                 free(list->array);
             }
             free(list);
@@ -253,12 +300,208 @@ void clean_vartype_pools() {
         free(complexpool[--complexpool_size]);
     while (stringpool_size > 0)
         free(stringpool[--stringpool_size]);
+    while (listpool_size > 0) {
+        vartype_list *list = listpool[--listpool_size];
+        free(list->array);
+        free(list);
+    }
+}
+
+/* String arenas. An arena is a chain of blocks; strings are only ever
+ * allocated from the head block, so pointers into the arena stay valid for
+ * as long as the arena lives. Blocks grow geometrically, up to a point.
+ */
+
+#define ARENA_MIN_BLOCK 1024
+#define ARENA_MAX_BLOCK 1048576
+
+struct string_arena_block {
+    string_arena_block *next;
+    int4 size;
+    int4 used;
+    // Followed by 'size' bytes of int4-aligned string storage
+};
+
+struct string_arena {
+    int refcount;
+    // Total bytes handed out, in all blocks
+    int4 used;
+    // When 'used' reaches this, put_matrix_string() checks how much of the
+    // arena is garbage, and compacts it if that is more than half
+    int4 compact_at;
+    string_arena_block *head;
+};
+
+static int4 string_block_bytes(int4 length) {
+    return (length + 7) & ~3;
+}
+
+static void release_arena(string_arena *a) {
+    if (a == NULL || --(a->refcount) > 0)
+        return;
+    string_arena_block *b = a->head;
+    while (b != NULL) {
+        string_arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
 }
 
-void free_long_strings(char *is_string, phloat *data, int4 n) {
+/* Makes sure that the next 'bytes' bytes worth of new_matrix_string() calls
+ * on this matrix will not fail. The byte count should be computed using
+ * long_strings_size() or string_block_bytes().
+ */
+bool reserve_matrix_strings(realmatrix_data *md, int4 bytes) {
+    string_arena *a = md->strings;
+    if (a == NULL) {
+        a = (string_arena *) malloc(sizeof(string_arena));
+        if (a == NULL)
+            return false;
+        a->refcount = 1;
+        a->used = 0;
+        a->compact_at = ARENA_MIN_BLOCK;
+        a->head = NULL;
+        md->strings = a;
+    }
+    if (a->head != NULL && a->head->size - a->head->used >= bytes)
+        return true;
+    int4 size;
+    if (a->head == NULL)
+        size = ARENA_MIN_BLOCK;
+    else if (a->head->size < ARENA_MAX_BLOCK / 2)
+        size = a->head->size * 2;
+    else
+        size = ARENA_MAX_BLOCK;
+    if (size < bytes)
+        size = bytes;
+    string_arena_block *b = (string_arena_block *)
+                        malloc(sizeof(string_arena_block) + size);
+    if (b == NULL)
+        return false;
+    b->next = a->head;
+    b->size = size;
+    b->used = 0;
+    a->head = b;
+    return true;
+}
+
+/* Allocates space for a long string in the matrix's arena, and sets its
+ * length; the caller fills in the text.
+ */
+int4 *new_matrix_string(realmatrix_data *md, int4 length) {
+    int4 bytes = string_block_bytes(length);
+    if (!reserve_matrix_strings(md, bytes))
+        return NULL;
+    string_arena_block *b = md->strings->head;
+    int4 *p = (int4 *) ((char *) (b + 1) + b->used);
+    b->used += bytes;
+    md->strings->used += bytes;
+    *p = length;
+    return p;
+}
+
+int4 long_strings_size(const char *is_string, const phloat *data, int4 n) {
+    int4 bytes = 0;
     for (int4 i = 0; i < n; i++)
         if (is_string[i] == 2)
-            free(*(void **) &data[i]);
+            bytes += string_block_bytes(**(int4 **) &data[i]);
+    return bytes;
+}
+
+/* Makes 'dst' use the same arena as 'src'; used when long-string pointers
+ * are copied from one matrix to another.
+ */
+void share_matrix_strings(realmatrix_data *dst, realmatrix_data *src) {
+    if (dst->strings == src->strings)
+        return;
+    release_arena(dst->strings);
+    dst->strings = src->strings;
+    if (dst->strings != NULL)
+        dst->strings->refcount++;
+}
+
+void free_matrix_strings(realmatrix_data *md) {
+    release_arena(md->strings);
+    md->strings = NULL;
+}
+
+/* Copies the long strings of the first 'sz' elements into a new arena,
+ * with room for 'extra' more bytes, and makes that the matrix's arena. The
+ * old arena is returned rather than released, since the caller may be
+ * copying text out of it. Returns NULL, leaving the matrix unchanged, if
+ * there is not enough memory.
+ */
+static string_arena *rebuild_matrix_strings(realmatrix_data *md, int4 sz, int4 live, int4 extra) {
+    realmatrix_data tmp;
+    tmp.strings = NULL;
+    if (!reserve_matrix_strings(&tmp, live + extra)) {
+        free_matrix_strings(&tmp);
+        return NULL;
+    }
+    tmp.strings->compact_at = 2 * (live + extra) + ARENA_MIN_BLOCK;
+    for (int4 i = 0; i < sz; i++)
+        if (md->is_string[i] == 2) {
+            int4 *srcp = *(int4 **) &md->data[i];
+            int4 *dstp = new_matrix_string(&tmp, *srcp);
+            memcpy(dstp + 1, srcp + 1, *srcp);
+            *(int4 **) &md->data[i] = dstp;
+        }
+    string_arena *old = md->strings;
+    md->strings = tmp.strings;
+    return old;
+}
+
+/* Strings that are overwritten stay in the arena until it is compacted.
+ * That is done here, when a new long string is about to be allocated. A
+ * shared arena can't be compacted, so on the first such write after the
+ * arena was shared, the matrix takes a private copy of its live strings;
+ * from then on, its garbage is its own. A private arena is compacted when
+ * at least half of it is garbage. That check involves a scan of the matrix,
+ * so it is only performed when the arena has doubled in size since the
+ * last check.
+ */
+static string_arena *compact_matrix_strings(vartype_realmatrix *rm, int4 extra) {
+    realmatrix_data *md = rm->array;
+    string_arena *a = md->strings;
+    if (a == NULL || a->refcount == 1 && a->used < a->compact_at)
+        return NULL;
+    int4 sz = rm->rows * rm->columns;
+    int4 live = long_strings_size(md->is_string, md->data, sz);
+    if (a->refcount == 1) {
+        a->compact_at = 2 * (live + extra) + ARENA_MIN_BLOCK;
+        if (live > a->used / 2)
+            return NULL;
+    }
+    return rebuild_matrix_strings(md, sz, live, extra);
+}
+
+/* Drops the arena's dead weight after a matrix has been made smaller, or
+ * built from part of another matrix: if the arena holds much more than the
+ * matrix's own long strings, those are copied into a private arena, so the
+ * rest can be freed once nothing else uses it. This is best-effort; if
+ * there is not enough memory, the matrix keeps the arena it has.
+ */
+void trim_matrix_strings(vartype_realmatrix *rm) {
+    realmatrix_data *md = rm->array;
+    string_arena *a = md->strings;
+    if (a == NULL)
+        return;
+    int4 sz = rm->rows * rm->columns;
+    int4 live = long_strings_size(md->is_string, md->data, sz);
+    if (live == 0)
+        free_matrix_strings(md);
+    else if (a->used > 2 * live + ARENA_MIN_BLOCK)
+        release_arena(rebuild_matrix_strings(md, sz, live, 0));
+}
+
+/* Makes room for 'bytes' bytes of new long strings, for callers that write
+ * many strings at once, like PUTM. Like put_matrix_string(), this compacts
+ * the arena first if enough of it has become garbage.
+ */
+bool prepare_matrix_strings(vartype_realmatrix *rm, int4 bytes) {
+    release_arena(compact_matrix_strings(rm, bytes));
+    return reserve_matrix_strings(rm->array, bytes);
 }
 
 void get_matrix_string(vartype_realmatrix *rm, int i, char **text, int4 *length) {
@@ -278,37 +521,161 @@ void get_matrix_string(const vartype_realmatrix *rm, int i, const char **text, i
 }
 
 bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 length) {
-    char *ptext;
-    int4 plength;
-    if (rm->array->is_string[i] != 0) {
-        get_matrix_string(rm, i, &ptext, &plength);
-        if (plength == length) {
-            memcpy(ptext, text, length);
-            return true;
-        }
-    }
+    /* Long strings are never overwritten in place: the arena may be shared
+     * with other matrices, and a pointer may occur more than once.
+     */
     if (length > SSLENM) {
-        int4 *p = (int4 *) malloc(length + 4);
+        string_arena *old = compact_matrix_strings(rm, string_block_bytes(length));
+        int4 *p = new_matrix_string(rm->array, length);
+        if (p != NULL)
+            memcpy(p + 1, text, length);
+        release_arena(old);
         if (p == NULL)
             return false;
-        *p = length;
-        memcpy(p + 1, text, length);
-        if (rm->array->is_string[i] == 2)
-            free(*(void **) &rm->array->data[i]);
+        if (rm->array->is_string[i] == 0)
+            rm->array->string_count++;
         *(int4 **) &rm->array->data[i] = p;
         rm->array->is_string[i] = 2;
     } else {
-        void *oldptr = rm->array->is_string[i] == 2 ? *(void **) &rm->array->data[i] : NULL;
         char *t = (char *) &rm->array->data[i];
         t[0] = length;
         memmove(t + 1, text, length);
+        if (rm->array->is_string[i] == 0)
+            rm->array->string_count++;
         rm->array->is_string[i] = 1;
-        if (oldptr != NULL)
-            free(oldptr);
     }
     return true;
 }
 
+void put_matrix_real(vartype_realmatrix *rm, int4 i, phloat x) {
+    if (rm->array->is_string[i] != 0) {
+        rm->array->is_string[i] = 0;
+        rm->array->string_count--;
+    }
+    rm->array->data[i] = x;
+}
+
+/* List indexes. POS on a list would otherwise have to compare the item with
+ * every element; for lists of at least LIST_INDEX_MIN elements, a hash index
+ * of the real, complex, and string elements is built the first time POS is
+ * used, and kept until the list is changed. Anything that changes a list in
+ * place must call invalidate_list_index(); disentangle() does that, which
+ * covers most cases.
+ */
+
+#define LIST_INDEX_MIN 64
+
+struct list_index {
+    // Number of list elements covered by the index
+    int4 size;
+    // Number of hash buckets; a power of two
+    int4 buckets;
+    // Followed by 'buckets' chain heads and 'size' chain links. Chains are
+    // in ascending element order and terminated by -1; elements that can't
+    // be hashed are not in any chain.
+};
+
+static uint4 hash_bytes(uint4 h, const void *p, int4 n) {
+    const unsigned char *b = (const unsigned char *) p;
+    for (int4 i = 0; i < n; i++)
+        h = (h ^ b[i]) * 16777619;
+    return h;
+}
+
+static uint4 hash_number(uint4 h, phloat x) {
+    // Hashing the double, rather than the phloat itself, makes numbers
+    // that compare equal hash the same, even in decimal, where they may
+    // have different representations. Also, -0 == 0.
+    double d = to_double(x);
+    if (d == 0)
+        d = 0;
+    return hash_bytes(h, &d, sizeof(double));
+}
+
+/* Hashes an item consistently with vartype_equals(). Returns false for
+ * types that are not indexed.
+ */
+static bool hash_vartype(const vartype *v, uint4 *hash) {
+    uint4 h = 2166136261U ^ v->type;
+    switch (v->type) {
+        case TYPE_REAL:
+            *hash = hash_number(h, ((vartype_real *) v)->x);
+            return true;
+        case TYPE_COMPLEX: {
+            vartype_complex *c = (vartype_complex *) v;
+            *hash = hash_number(hash_number(h, c->re), c->im);
+            return true;
+        }
+        case TYPE_STRING: {
+            vartype_string *s = (vartype_string *) v;
+            *hash = hash_bytes(h, s->txt(), s->length);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static list_index *build_list_index(vartype **data, int4 size) {
+    if (size > 0x10000000)
+        return NULL;
+    int4 buckets = 1;
+    while (buckets < size)
+        buckets <<= 1;
+    list_index *li = (list_index *) malloc(sizeof(list_index) + (buckets + size) * sizeof(int4));
+    if (li == NULL)
+        return NULL;
+    li->size = size;
+    li->buckets = buckets;
+    int4 *heads = (int4 *) (li + 1);
+    int4 *next = heads + buckets;
+    for (int4 i = 0; i < buckets; i++)
+        heads[i] = -1;
+    for (int4 i = size - 1; i >= 0; i--) {
+        uint4 h;
+        if (data[i] != NULL && hash_vartype(data[i], &h)) {
+            int4 b = h & (buckets - 1);
+            next[i] = heads[b];
+            heads[b] = i;
+        } else
+            next[i] = -1;
+    }
+    return li;
+}
+
+/* Returns the index of the first element at or after 'startpos' that is
+ * equal to 'item', or -1 if there is none.
+ */
+int4 find_list_item(vartype_list *list, const vartype *item, int4 startpos) {
+    list_data *ld = list->array;
+    uint4 h;
+    if (list->size >= LIST_INDEX_MIN && hash_vartype(item, &h)) {
+        if (ld->index != NULL && ld->index->size != list->size)
+            invalidate_list_index(ld);
+        if (ld->index == NULL)
+            ld->index = build_list_index(ld->data, list->size);
+        list_index *li = ld->index;
+        if (li != NULL) {
+            int4 *heads = (int4 *) (li + 1);
+            int4 *next = heads + li->buckets;
+            for (int4 i = heads[h & (li->buckets - 1)]; i != -1; i = next[i])
+                if (i >= startpos && vartype_equals(ld->data[i], item))
+                    return i;
+            return -1;
+        }
+        /* Out of memory; fall back on a linear search */
+    }
+    for (int4 i = startpos; i < list->size; i++)
+        if (vartype_equals(ld->data[i], item))
+            return i;
+    return -1;
+}
+
+void invalidate_list_index(list_data *ld) {
+    free(ld->index);
+    ld->index = NULL;
+}
+
 vartype *dup_vartype(const vartype *v) {
     if (v == NULL)
         return NULL;
@@ -371,7 +738,6 @@ bool disentangle(vartype *v) {
                 if (md == NULL)
                     return false;
                 int4 sz = rm->rows * rm->columns;
-                int4 i;
                 md->data = (phloat *) malloc(sz * sizeof(phloat));
                 if (md->data == NULL) {
                     free(md);
@@ -383,25 +749,15 @@ bool disentangle(vartype *v) {
                     free(md);
                     return false;
                 }
-                for (i = 0; i < sz; i++) {
-                    md->is_string[i] = rm->array->is_string[i];
-                    if (md->is_string[i] == 2) {
-                        int4 *sp = *(int4 **) &rm->array->data[i];
-                        int4 len = *sp + 4;
-                        int4 *dp = (int4 *) malloc(len);
-                        if (dp == NULL) {
-                            free_long_strings(md->is_string, md->data, i);
-                            free(md->is_string);
-                            free(md->data);
-                            free(md);
-                            return false;
-                        }
-                        memcpy(dp, sp, len);
-                        *(int4 **) &md->data[i] = dp;
-                    } else {
-                        md->data[i] = rm->array->data[i];
-                    }
-                }
+                // The long strings stay where they are; the copy shares
+                // the arena, and the pointers are copied along with the
+                // numbers.
+                memcpy(md->is_string, rm->array->is_string, sz);
+                memcpy((void *) md->data, (const void *) rm->array->data, sz * sizeof(phloat));
+                md->strings = NULL;
+                share_matrix_strings(md, rm->array);
+                md->string_count = rm->array->string_count;
+                md->capacity = sz;
                 md->refcount = 1;
                 rm->array->refcount--;
                 rm->array = md;
@@ -426,6 +782,7 @@ bool disentangle(vartype *v) {
                 }
                 for (i = 0; i < sz; i++)
                     md->data[i] = cm->array->data[i];
+                md->capacity = cm->rows * cm->columns;
                 md->refcount = 1;
                 cm->array->refcount--;
                 cm->array = md;
@@ -434,9 +791,11 @@ bool disentangle(vartype *v) {
         }
         case TYPE_LIST: {
             vartype_list *list = (vartype_list *) v;
-            if (list->array->refcount == 1)
+            if (list->array->refcount == 1) {
+                /* Not shared, but presumably about to be modified */
+                invalidate_list_index(list->array);
                 return true;
-            else {
+            } else {
                 list_data *ld = (list_data *) malloc(sizeof(list_data));
                 if (ld == NULL)
                     return false;
@@ -459,6 +818,7 @@ bool disentangle(vartype *v) {
                     }
                     ld->data[i] = vv;
                 }
+                ld->index = NULL;
                 ld->refcount = 1;
                 list->array->refcount--;
                 list->array = ld;
@@ -528,6 +888,8 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
             vars[varindex].name[i] = name[i];
         vars[varindex].level = local ? get_rtn_level() : -1;
         vars[varindex].flags = 0;
+        if (local)
+            local_vars_count++;
     } else if (local && vars[varindex].level < get_rtn_level()) {
         /* Create local that hides an existing variable */
         if (vars_count == vars_capacity) {
@@ -539,12 +901,15 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
             vars = nv;
         }
         vars[varindex].flags |= VAR_HIDDEN;
+        int hidden = varindex;
         varindex = vars_count++;
         vars[varindex].length = namelength;
         for (i = 0; i < namelength; i++)
             vars[varindex].name[i] = name[i];
         vars[varindex].level = get_rtn_level();
         vars[varindex].flags = VAR_HIDING;
+        vars[varindex].hides = hidden;
+        local_vars_count++;
     } else {
         /* Update existing variable */
         if (matedit_mode == 1 &&
@@ -564,10 +929,24 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
         free_vartype(vars[varindex].value);
     }
     vars[varindex].value = value;
+    vars_changed();
     update_catalog();
     return ERR_NONE;
 }
 
+/* Removes vars[varindex], shifting the following entries down, and keeping
+ * the 'hides' indexes of the shifted entries in sync. The removed variable
+ * must not be hidden by anything.
+ */
+static void remove_var_entry(int varindex) {
+    for (int i = varindex; i < vars_count - 1; i++) {
+        vars[i] = vars[i + 1];
+        if ((vars[i].flags & VAR_HIDING) != 0 && vars[i].hides > varindex)
+            vars[i].hides--;
+    }
+    vars_count--;
+}
+
 bool purge_var(const char *name, int namelength, bool global, bool local) {
     int varindex = lookup_var(name, namelength);
     if (varindex == -1)
@@ -596,16 +975,12 @@ bool purge_var(const char *name, int namelength, bool global, bool local) {
         matedit_stack_depth = 0;
     }
     free_vartype(vars[varindex].value);
-    if ((vars[varindex].flags & VAR_HIDING) != 0) {
-        for (int i = varindex - 1; i >= 0; i--)
-            if ((vars[i].flags & VAR_HIDDEN) != 0 && string_equals(vars[i].name, vars[i].length, name, namelength)) {
-                vars[i].flags &= ~VAR_HIDDEN;
-                break;
-            }
-    }
-    for (int i = varindex; i < vars_count - 1; i++)
-        vars[i] = vars[i + 1];
-    vars_count--;
+    if ((vars[varindex].flags & VAR_HIDING) != 0)
+        vars[vars[varindex].hides].flags &= ~VAR_HIDDEN;
+    if (vars[varindex].level != -1)
+        local_vars_count--;
+    remove_var_entry(varindex);
+    vars_changed();
     update_catalog();
     return true;
 }
@@ -615,53 +990,88 @@ void purge_all_vars() {
     for (i = 0; i < vars_count; i++)
         free_vartype(vars[i].value);
     vars_count = 0;
+    local_vars_count = 0;
+    vars_changed();
 }
 
-bool vars_exist(int section) {
-    int i;
-    for (i = 0; i < vars_count; i++) {
-        if ((vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) != 0)
+/* Recomputes local_vars_count and the 'hides' indexes from scratch,
+ * for use after vars[] has been loaded from the state file.
+ */
+void index_local_vars() {
+    local_vars_count = 0;
+    for (int i = 0; i < vars_count; i++) {
+        if (vars[i].level == -1)
             continue;
-        if (section == -1)
-            return true;
-        switch (vars[i].value->type) {
-            case TYPE_REAL:
-                if (section == CATSECT_REAL)
-                    return true;
-                else
-                    break;
-            case TYPE_STRING:
-                if (section == CATSECT_REAL || section == CATSECT_LIST_STR_ONLY)
-                    return true;
-                else
-                    break;
-            case TYPE_COMPLEX:
-                if (section == CATSECT_CPX)
-                    return true;
-                else
-                    break;
-            case TYPE_REALMATRIX:
-            case TYPE_COMPLEXMATRIX:
-                if (section == CATSECT_MAT || section == CATSECT_MAT_LIST)
-                    return true;
-                else
-                    break;
-            case TYPE_LIST:
-                if (section == CATSECT_LIST_STR_ONLY || section == CATSECT_MAT_LIST || section == CATSECT_LIST)
-                    return true;
-                else
-                    break;
-        }
+        local_vars_count++;
+        if ((vars[i].flags & VAR_HIDING) == 0)
+            continue;
+        vars[i].hides = -1;
+        for (int j = i - 1; j >= 0; j--)
+            if ((vars[j].flags & VAR_HIDDEN) != 0 && string_equals(vars[i].name, vars[i].length, vars[j].name, vars[j].length)) {
+                vars[i].hides = j;
+                break;
+            }
+        if (vars[i].hides == -1)
+            // Shouldn't happen
+            vars[i].flags &= ~VAR_HIDING;
+    }
+    vars_changed();
+}
+
+/* Number of visible (neither hidden nor private) variables of each type,
+ * so vars_exist() doesn't have to scan vars[] every time a catalog is
+ * refreshed. Recounted lazily after vars_changed().
+ */
+static int visible_vars[TYPE_LIST + 1];
+static bool visible_vars_valid = false;
+
+void vars_changed() {
+    visible_vars_valid = false;
+    invalidate_catalog_index();
+}
+
+bool vars_exist(int section) {
+    if (!visible_vars_valid) {
+        for (int t = 0; t <= TYPE_LIST; t++)
+            visible_vars[t] = 0;
+        for (int i = 0; i < vars_count; i++)
+            if ((vars[i].flags & (VAR_HIDDEN | VAR_PRIVATE)) == 0)
+                visible_vars[vars[i].value->type]++;
+        visible_vars_valid = true;
+    }
+    int mat = visible_vars[TYPE_REALMATRIX] + visible_vars[TYPE_COMPLEXMATRIX];
+    switch (section) {
+        case -1:
+            return visible_vars[TYPE_REAL] + visible_vars[TYPE_STRING]
+                    + visible_vars[TYPE_COMPLEX] + mat
+                    + visible_vars[TYPE_LIST] != 0;
+        case CATSECT_REAL:
+            return visible_vars[TYPE_REAL] + visible_vars[TYPE_STRING] != 0;
+        case CATSECT_LIST_STR_ONLY:
+            return visible_vars[TYPE_STRING] + visible_vars[TYPE_LIST] != 0;
+        case CATSECT_CPX:
+            return visible_vars[TYPE_COMPLEX] != 0;
+        case CATSECT_MAT:
+            return mat != 0;
+        case CATSECT_MAT_LIST:
+            return mat + visible_vars[TYPE_LIST] != 0;
+        case CATSECT_LIST:
+            return visible_vars[TYPE_LIST] != 0;
+        default:
+            return false;
     }
-    return false;
 }
 
 bool contains_strings(const vartype_realmatrix *rm) {
-    int4 size = rm->rows * rm->columns;
-    for (int4 i = 0; i < size; i++)
-        if (rm->array->is_string[i] != 0)
-            return true;
-    return false;
+    return rm->array->string_count != 0;
+}
+
+int4 count_strings(const char *is_string, int4 n) {
+    int4 count = 0;
+    for (int4 i = 0; i < n; i++)
+        if (is_string[i] != 0)
+            count++;
+    return count;
 }
 
 /* This is only used by core_linalg1, and does not deal with strings,
@@ -678,8 +1088,9 @@ int matrix_copy(vartype *dst, const vartype *src) {
             if (contains_strings(s))
                 return ERR_ALPHA_DATA_IS_INVALID;
             int4 size = s->rows * s->columns;
-            free_long_strings(d->array->is_string, d->array->data, size);
+            free_matrix_strings(d->array);
             memset(d->array->is_string, 0, size);
+            d->array->string_count = 0;
             memcpy((void *) d->array->data, (const void *) s->array->data, size * sizeof(phloat));
             return ERR_NONE;
         } else if (dst->type == TYPE_COMPLEXMATRIX) {
@@ -744,9 +1155,9 @@ vartype *recall_and_purge_private_var(const char *name, int namelength) {
     if (varindex == -1)
         return NULL;
     vartype *ret = vars[varindex].value;
-    for (int i = varindex; i < vars_count - 1; i++)
-        vars[i] = vars[i + 1];
-    vars_count--;
+    remove_var_entry(varindex);
+    local_vars_count--;
+    vars_changed();
     return ret;
 }
 
@@ -768,6 +1179,7 @@ int store_private_var(const char *name, int namelength, vartype *value) {
             vars[varindex].name[i] = name[i];
         vars[varindex].level = get_rtn_level();
         vars[varindex].flags = VAR_PRIVATE;
+        local_vars_count++;
     } else {
         free_vartype(vars[varindex].value);
     }
@@ -49,10 +49,27 @@ struct vartype_complex {
 };
 
 
+/* Long strings (is_string == 2) live in a string arena that belongs to
+ * the realmatrix_data; the phloat slot holds a pointer to an int4 length
+ * followed by the text. The arena is append-only and reference-counted, so
+ * copies of a matrix can share it without copying any strings, and it is
+ * released in one go when the last matrix using it goes away. Strings that
+ * are overwritten are reclaimed when the arena gets compacted; see
+ * put_matrix_string().
+ */
+struct string_arena;
+
 struct realmatrix_data {
     int refcount;
     phloat *data;
     char *is_string;
+    string_arena *strings;
+    // Number of elements with is_string != 0, so that purely numeric
+    // matrices can be recognized without scanning is_string.
+    int4 string_count;
+    // Number of elements 'data' and 'is_string' have room for; at least
+    // rows * columns. See dimension_array_ref().
+    int4 capacity;
 };
 
 struct vartype_realmatrix {
@@ -66,6 +83,8 @@ struct vartype_realmatrix {
 struct complexmatrix_data {
     int refcount;
     phloat *data;
+    // Number of complex elements 'data' has room for
+    int4 capacity;
 };
 
 struct vartype_complexmatrix {
@@ -84,6 +103,8 @@ struct vartype_complexmatrix {
 struct vartype_string {
     int type;
     int4 length;
+    // Size of the buffer at t.ptr, when length > SSLENV; see reserve_string()
+    int4 capacity;
     /* When length <= SSLENV, use buf; otherwise, use ptr */
     union {
         char buf[SSLENV];
@@ -99,9 +120,14 @@ struct vartype_string {
 };
 
 
+struct list_index;
+
 struct list_data {
     int refcount;
     vartype **data;
+    // Hash index for POS; built on demand by find_list_item(), and
+    // discarded by invalidate_list_index() whenever the data changes.
+    list_index *index;
 };
 
 struct vartype_list {
@@ -114,15 +140,25 @@ struct vartype_list {
 vartype *new_real(phloat value);
 vartype *new_complex(phloat re, phloat im);
 vartype *new_string(const char *s, int slen);
+bool reserve_string(vartype_string *s, int4 length);
 vartype *new_realmatrix(int4 rows, int4 columns);
 vartype *new_complexmatrix(int4 rows, int4 columns);
 vartype *new_list(int4 size);
 void free_vartype(vartype *v);
 void clean_vartype_pools();
-void free_long_strings(char *is_string, phloat *data, int4 n);
+int4 *new_matrix_string(realmatrix_data *md, int4 length);
+bool reserve_matrix_strings(realmatrix_data *md, int4 bytes);
+int4 long_strings_size(const char *is_string, const phloat *data, int4 n);
+void share_matrix_strings(realmatrix_data *dst, realmatrix_data *src);
+void free_matrix_strings(realmatrix_data *md);
+void trim_matrix_strings(vartype_realmatrix *rm);
+bool prepare_matrix_strings(vartype_realmatrix *rm, int4 bytes);
 void get_matrix_string(vartype_realmatrix *rm, int4 i, char **text, int4 *length);
 void get_matrix_string(const vartype_realmatrix *rm, int4 i, const char **text, int4 *length);
 bool put_matrix_string(vartype_realmatrix *rm, int4 i, const char *text, int4 length);
+void put_matrix_real(vartype_realmatrix *rm, int4 i, phloat x);
+int4 find_list_item(vartype_list *list, const vartype *item, int4 startpos);
+void invalidate_list_index(list_data *ld);
 vartype *dup_vartype(const vartype *v);
 bool disentangle(vartype *v);
 int lookup_var(const char *name, int namelength);
@@ -131,8 +167,11 @@ bool ensure_var_space(int n);
 int store_var(const char *name, int namelength, vartype *value, bool local = false);
 bool purge_var(const char *name, int namelength, bool global = true, bool local = true);
 void purge_all_vars();
+void index_local_vars();
+void vars_changed();
 bool vars_exist(int section);
 bool contains_strings(const vartype_realmatrix *rm);
+int4 count_strings(const char *is_string, int4 n);
 int matrix_copy(vartype *dst, const vartype *src);
 vartype *recall_private_var(const char *name, int namelength);
 vartype *recall_and_purge_private_var(const char *name, int namelength);
@@ -28,6 +28,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <time.h>
 
@@ -95,11 +96,43 @@ static bool enqueued;
 
 /* Private globals */
 
+/* The print_txt and print_gif files are owned by the print spooler thread;
+ * the main thread only touches them after print_spooler_sync() has returned.
+ */
 static FILE *print_txt = NULL;
 static FILE *print_gif = NULL;
 static char print_gif_name[FILENAMELEN];
 static int gif_seq = -1;
 static int gif_lines;
+static bool print_txt_failed = false;
+static bool print_gif_failed = false;
+
+/* Print jobs waiting to be written to the text and GIF files. shell_print()
+ * only blocks when this queue is full.
+ */
+struct print_job {
+    char *text;
+    int length;
+    char *bits;
+    int bytesperline, x, width, height;
+    bool to_txt, to_gif;
+    int gif_max_length;
+};
+
+#define PRINT_QUEUE_SIZE 1024
+
+static print_job print_queue[PRINT_QUEUE_SIZE];
+static int print_queue_head = 0;
+static int print_queue_count = 0;
+static bool print_spooler_busy = false;
+static bool print_spooler_running = false;
+static bool print_spooler_stop = false;
+static int4 print_lines_blocked = 0;
+static int4 print_lines_dropped = 0;
+static pthread_t print_spooler_thread;
+static pthread_mutex_t print_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t print_queue_nonempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t print_queue_drained = PTHREAD_COND_INITIALIZER;
 
 static int pype[2];
 
@@ -206,6 +239,8 @@ static void txt_writer(const char *text, int length);
 static void txt_newliner();
 static void gif_seeker(int4 pos);
 static void gif_writer(const char *text, int length);
+static void print_spooler_sync();
+static void print_spooler_exit();
 
 
 #ifdef BCD_MATH
@@ -930,6 +965,8 @@ static gboolean resizer(gpointer cd) {
     skin_get_window_size(&win_width, &win_height);
     int mh = menu_bar_height >= 2 ? menu_bar_height : 0;
     gtk_window_resize(GTK_WINDOW(mainwindow), win_width, win_height + mh);
+    skin_update_scaled_cache();
+    gtk_widget_queue_draw(calc_widget);
     resize_timeout_id = 0;
     return FALSE;
 }
@@ -1279,6 +1316,8 @@ static void quit() {
         ;
     }
 
+    print_spooler_exit();
+
     if (print_txt != NULL)
         fclose(print_txt);
 
@@ -2338,6 +2377,7 @@ static void clearPrintOutCB() {
     print_text_pixel_height = 0;
     gtk_widget_set_size_request(print_widget, 358, 1);
 
+    print_spooler_sync();
     if (print_gif != NULL) {
         shell_finish_gif(gif_seeker, gif_writer);
         fclose(print_gif);
@@ -2479,6 +2519,9 @@ static void preferencesCB() {
             core_update_allow_big_stack();
         core_settings.localized_copy_paste = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(localizedcopypaste));
 
+        print_spooler_sync();
+        print_txt_failed = false;
+        print_gif_failed = false;
         state.printerToTxtFile = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(printtotext));
         char *old = strclone(state.printerTxtFileName);
         const char *s = gtk_entry_get_text(GTK_ENTRY(textpath));
@@ -3159,7 +3202,38 @@ static gboolean reminder(gpointer cd) {
     }
 }
 
-/* Callbacks used by shell_print() and shell_spool_txt() / shell_spool_gif() */
+/* Callbacks used by the print spooler and shell_spool_txt() / shell_spool_gif().
+ * These run on the print spooler thread, so errors are reported to the main
+ * thread by print_error() instead of being shown directly.
+ */
+
+struct print_error_info {
+    bool gif;
+    char *message;
+};
+
+static gboolean print_error_cb(gpointer cd) {
+    print_error_info *info = (print_error_info *) cd;
+    if (info->gif)
+        state.printerToGifFile = 0;
+    else
+        state.printerToTxtFile = 0;
+    show_message("Message", info->message);
+    free(info->message);
+    delete info;
+    return FALSE;
+}
+
+static void print_error(bool gif, const char *message) {
+    if (gif)
+        print_gif_failed = true;
+    else
+        print_txt_failed = true;
+    print_error_info *info = new print_error_info;
+    info->gif = gif;
+    info->message = strclone(message);
+    g_idle_add(print_error_cb, info);
+}
 
 static void txt_writer(const char *text, int length) {
     int n;
@@ -3168,11 +3242,10 @@ static void txt_writer(const char *text, int length) {
     n = fwrite(text, 1, length, print_txt);
     if (n != length) {
         char buf[1000];
-        state.printerToTxtFile = 0;
         fclose(print_txt);
         print_txt = NULL;
         snprintf(buf, 1000, "Error while writing to \"%s\".\nPrinting to text file disabled", state.printerTxtFileName);
-        show_message("Message", buf);
+        print_error(false, buf);
     }
 }   
     
@@ -3181,7 +3254,6 @@ static void txt_newliner() {
         return;
     fputc('\r', print_txt);
     fputc('\n', print_txt);
-    fflush(print_txt);
 }   
     
 static void gif_seeker(int4 pos) {
@@ -3189,11 +3261,10 @@ static void gif_seeker(int4 pos) {
         return;
     if (fseek(print_gif, pos, SEEK_SET) == -1) {
         char buf[1000];
-        state.printerToGifFile = 0;
         fclose(print_gif);
         print_gif = NULL;
         snprintf(buf, 1000, "Error while seeking \"%s\".\nPrinting to GIF file disabled", print_gif_name);
-        show_message("Message", buf);
+        print_error(true, buf);
     }
 }
 
@@ -3204,12 +3275,241 @@ static void gif_writer(const char *text, int length) {
     n = fwrite(text, 1, length, print_gif);
     if (n != length) {
         char buf[1000];
-        state.printerToGifFile = 0;
         fclose(print_gif);
         print_gif = NULL;
         snprintf(buf, 1000, "Error while writing to \"%s\".\nPrinting to GIF file disabled", print_gif_name);
-        show_message("Message", buf);
+        print_error(true, buf);
+    }
+}
+
+/* Print spooler thread */
+
+static void spool_txt(const print_job *job) {
+    if (print_txt_failed) {
+        print_lines_dropped++;
+        return;
+    }
+    if (print_txt == NULL) {
+        print_txt = fopen(state.printerTxtFileName, "a");
+        if (print_txt == NULL) {
+            int err = errno;
+            char buf[1000];
+            snprintf(buf, 1000, "Can't open \"%s\" for output:\n%s (%d)\nPrinting to text file disabled.", state.printerTxtFileName, strerror(err), err);
+            print_error(false, buf);
+            print_lines_dropped++;
+            return;
+        }
     }
+
+    if (job->text != NULL)
+        shell_spool_txt(job->text, job->length, txt_writer, txt_newliner);
+    else
+        shell_spool_bitmap_to_txt(job->bits, job->bytesperline, job->x, 0, job->width, job->height, txt_writer, txt_newliner);
+}
+
+static void spool_gif(const print_job *job) {
+    if (print_gif_failed) {
+        print_lines_dropped++;
+        return;
+    }
+    if (print_gif != NULL
+            && gif_lines + job->height > job->gif_max_length) {
+        shell_finish_gif(gif_seeker, gif_writer);
+        fclose(print_gif);
+        print_gif = NULL;
+    }
+
+    if (print_gif == NULL) {
+        while (1) {
+            int len, p;
+
+            gif_seq = (gif_seq + 1) % 10000;
+
+            strcpy(print_gif_name, state.printerGifFileName);
+            len = strlen(print_gif_name);
+
+            /* Strip ".gif" extension, if present */
+            if (len >= 4 &&
+                    strcasecmp(print_gif_name + len - 4, ".gif") == 0) {
+                len -= 4;
+                print_gif_name[len] = 0;
+            }
+
+            /* Strip ".[0-9]+", if present */
+            p = len;
+            while (p > 0 && print_gif_name[p] >= '0'
+                         && print_gif_name[p] <= '9')
+                p--;
+            if (p < len && p >= 0 && print_gif_name[p] == '.')
+                print_gif_name[p] = 0;
+
+            /* Make sure we have enough space for the ".nnnn.gif" */
+            p = FILENAMELEN - 10;
+            print_gif_name[p] = 0;
+            p = strlen(print_gif_name);
+            snprintf(print_gif_name + p, 6, ".%04d", gif_seq);
+            strcat(print_gif_name, ".gif");
+
+            if (!file_exists(print_gif_name))
+                break;
+        }
+        print_gif = fopen(print_gif_name, "w+");
+        if (print_gif == NULL) {
+            int err = errno;
+            char buf[1000];
+            snprintf(buf, 1000, "Can't open \"%s\" for output:\n%s (%d)\nPrinting to GIF file disabled.", print_gif_name, strerror(err), err);
+            print_error(true, buf);
+            print_lines_dropped++;
+            return;
+        }
+        if (!shell_start_gif(gif_writer, 143, job->gif_max_length)) {
+            fclose(print_gif);
+            print_gif = NULL;
+            print_error(true, "Not enough memory for the GIF encoder.\nPrinting to GIF file disabled.");
+            print_lines_dropped++;
+            return;
+        }
+        gif_lines = 0;
+    }
+
+    shell_spool_gif(job->bits, job->bytesperline, job->x, 0, job->width, job->height, gif_writer);
+    gif_lines += job->height;
+
+    if (print_gif != NULL && gif_lines + 9 > job->gif_max_length) {
+        shell_finish_gif(gif_seeker, gif_writer);
+        fclose(print_gif);
+        print_gif = NULL;
+    }
+}
+
+static void *print_spooler(void *) {
+    pthread_mutex_lock(&print_queue_mutex);
+    while (true) {
+        while (print_queue_count == 0 && !print_spooler_stop)
+            pthread_cond_wait(&print_queue_nonempty, &print_queue_mutex);
+        if (print_queue_count == 0)
+            break;
+        print_job job = print_queue[print_queue_head];
+        print_queue_head = (print_queue_head + 1) % PRINT_QUEUE_SIZE;
+        print_queue_count--;
+        bool more = print_queue_count > 0;
+        print_spooler_busy = true;
+        pthread_cond_broadcast(&print_queue_drained);
+        pthread_mutex_unlock(&print_queue_mutex);
+
+        if (job.to_txt)
+            spool_txt(&job);
+        if (job.to_gif)
+            spool_gif(&job);
+        // Flush once the queue is empty, rather than after every line,
+        // so a backlog is written in large chunks
+        if (print_txt != NULL && !more)
+            fflush(print_txt);
+        free(job.text);
+        free(job.bits);
+
+        pthread_mutex_lock(&print_queue_mutex);
+        print_spooler_busy = false;
+        pthread_cond_broadcast(&print_queue_drained);
+    }
+    pthread_mutex_unlock(&print_queue_mutex);
+    return NULL;
+}
+
+/* print_spooler_enqueue()
+ *
+ * Hands a copy of a print job to the spooler thread. Only blocks if the
+ * queue is full.
+ */
+static void print_spooler_enqueue(const char *text, int length,
+                                  const char *bits, int bytesperline,
+                                  int x, int y, int width, int height) {
+    print_job job;
+    if (text != NULL) {
+        job.text = (char *) malloc(length > 0 ? length : 1);
+        if (job.text == NULL) {
+            print_lines_dropped++;
+            return;
+        }
+        memcpy(job.text, text, length);
+    } else
+        job.text = NULL;
+    job.length = length;
+    job.bits = (char *) malloc(height > 0 ? bytesperline * height : 1);
+    if (job.bits == NULL) {
+        free(job.text);
+        print_lines_dropped++;
+        return;
+    }
+    memcpy(job.bits, bits + y * bytesperline, bytesperline * height);
+    job.bytesperline = bytesperline;
+    job.x = x;
+    job.width = width;
+    job.height = height;
+    job.to_txt = state.printerToTxtFile != 0;
+    job.to_gif = state.printerToGifFile != 0;
+    job.gif_max_length = state.printerGifMaxLength;
+
+    pthread_mutex_lock(&print_queue_mutex);
+    if (!print_spooler_running) {
+        print_spooler_stop = false;
+        print_spooler_running = pthread_create(&print_spooler_thread, NULL, print_spooler, NULL) == 0;
+        if (!print_spooler_running) {
+            // No thread; fall back on spooling synchronously
+            pthread_mutex_unlock(&print_queue_mutex);
+            if (job.to_txt)
+                spool_txt(&job);
+            if (job.to_gif)
+                spool_gif(&job);
+            if (print_txt != NULL)
+                fflush(print_txt);
+            free(job.text);
+            free(job.bits);
+            return;
+        }
+    }
+    if (print_queue_count == PRINT_QUEUE_SIZE) {
+        print_lines_blocked++;
+        while (print_queue_count == PRINT_QUEUE_SIZE)
+            pthread_cond_wait(&print_queue_drained, &print_queue_mutex);
+    }
+    print_queue[(print_queue_head + print_queue_count) % PRINT_QUEUE_SIZE] = job;
+    print_queue_count++;
+    pthread_cond_signal(&print_queue_nonempty);
+    pthread_mutex_unlock(&print_queue_mutex);
+}
+
+/* print_spooler_sync()
+ *
+ * Waits until all queued print jobs have been written. After this returns,
+ * and until the next shell_print(), the main thread may use print_txt and
+ * print_gif directly.
+ */
+static void print_spooler_sync() {
+    pthread_mutex_lock(&print_queue_mutex);
+    while (print_queue_count > 0 || print_spooler_busy)
+        pthread_cond_wait(&print_queue_drained, &print_queue_mutex);
+    pthread_mutex_unlock(&print_queue_mutex);
+}
+
+/* print_spooler_exit()
+ *
+ * Flushes the print queue and stops the spooler thread. Call this before
+ * closing the print files at exit.
+ */
+static void print_spooler_exit() {
+    pthread_mutex_lock(&print_queue_mutex);
+    bool running = print_spooler_running;
+    print_spooler_stop = true;
+    pthread_cond_signal(&print_queue_nonempty);
+    pthread_mutex_unlock(&print_queue_mutex);
+    if (running) {
+        pthread_join(print_spooler_thread, NULL);
+        print_spooler_running = false;
+    }
+    if (print_lines_blocked > 0 || print_lines_dropped > 0)
+        fprintf(stderr, "Print spooler: %d lines blocked on full queue, %d lines dropped\n",
+                (int) print_lines_blocked, (int) print_lines_dropped);
 }
 
 void shell_blitter(const char *bits, int bytesperline, int x, int y,
@@ -3550,99 +3850,8 @@ void shell_print(const char *text, int length,
                          (gpointer) new print_growth_info(oldlength, 2 * height));
     }
 
-    if (state.printerToTxtFile) {
-        int err;
-        char buf[1000];
-
-        if (print_txt == NULL) {
-            print_txt = fopen(state.printerTxtFileName, "a");
-            if (print_txt == NULL) {
-                err = errno;
-                state.printerToTxtFile = 0;
-                snprintf(buf, 1000, "Can't open \"%s\" for output:\n%s (%d)\nPrinting to text file disabled.", state.printerTxtFileName, strerror(err), err);
-                show_message("Message", buf);
-                goto done_print_txt;
-            }
-        }
-
-        if (text != NULL)
-            shell_spool_txt(text, length, txt_writer, txt_newliner);
-        else
-            shell_spool_bitmap_to_txt(bits, bytesperline, x, y, width, height, txt_writer, txt_newliner);
-        done_print_txt:;
-    }
-
-    if (state.printerToGifFile) {
-        int err;
-        char buf[1000];
-
-        if (print_gif != NULL
-                && gif_lines + height > state.printerGifMaxLength) {
-            shell_finish_gif(gif_seeker, gif_writer);
-            fclose(print_gif);
-            print_gif = NULL;
-        }
-
-        if (print_gif == NULL) {
-            while (1) {
-                int len, p;
-
-                gif_seq = (gif_seq + 1) % 10000;
-
-                strcpy(print_gif_name, state.printerGifFileName);
-                len = strlen(print_gif_name);
-
-                /* Strip ".gif" extension, if present */
-                if (len >= 4 &&
-                        strcasecmp(print_gif_name + len - 4, ".gif") == 0) {
-                    len -= 4;
-                    print_gif_name[len] = 0;
-                }
-
-                /* Strip ".[0-9]+", if present */
-                p = len;
-                while (p > 0 && print_gif_name[p] >= '0'
-                             && print_gif_name[p] <= '9')
-                    p--;
-                if (p < len && p >= 0 && print_gif_name[p] == '.')
-                    print_gif_name[p] = 0;
-
-                /* Make sure we have enough space for the ".nnnn.gif" */
-                p = FILENAMELEN - 10;
-                print_gif_name[p] = 0;
-                p = strlen(print_gif_name);
-                snprintf(print_gif_name + p, 6, ".%04d", gif_seq);
-                strcat(print_gif_name, ".gif");
-
-                if (!file_exists(print_gif_name))
-                    break;
-            }
-            print_gif = fopen(print_gif_name, "w+");
-            if (print_gif == NULL) {
-                err = errno;
-                state.printerToGifFile = 0;
-                snprintf(buf, 1000, "Can't open \"%s\" for output:\n%s (%d)\nPrinting to GIF file disabled.", print_gif_name, strerror(err), err);
-                show_message("Message", buf);
-                goto done_print_gif;
-            }
-            if (!shell_start_gif(gif_writer, 143, state.printerGifMaxLength)) {
-                state.printerToGifFile = 0;
-                show_message("Message", "Not enough memory for the GIF encoder.\nPrinting to GIF file disabled.");
-                goto done_print_gif;
-            }
-            gif_lines = 0;
-        }
-
-        shell_spool_gif(bits, bytesperline, x, y, width, height, gif_writer);
-        gif_lines += height;
-
-        if (print_gif != NULL && gif_lines + 9 > state.printerGifMaxLength) {
-            shell_finish_gif(gif_seeker, gif_writer);
-            fclose(print_gif);
-            print_gif = NULL;
-        }
-        done_print_gif:;
-    }
+    if (state.printerToTxtFile || state.printerToGifFile)
+        print_spooler_enqueue(text, length, bits, bytesperline, x, y, width, height);
 
     print_text[print_text_bottom++] = (char) (text == NULL ? 255 : length);
     if (print_text_bottom == PRINT_TEXT_SIZE)
@@ -21,8 +21,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <math.h>
+#include <unistd.h>
 #include <string>
 #include <set>
 
@@ -89,6 +93,7 @@ static SkinMacro *macrolist = NULL;
 static SkinAnnunciator annunciators[7];
 
 static FILE *external_file;
+static string skin_file_id;
 static long builtin_length;
 static long builtin_pos;
 static const unsigned char *builtin_file;
@@ -105,6 +110,23 @@ static int keymap_length;
 
 static int window_width, window_height;
 
+/* Copies of the skin image, pre-scaled to the window size. These are rebuilt
+ * by skin_update_scaled_cache() once the window has stopped resizing, so that
+ * repaints, and key presses in particular, are plain blits instead of scaling
+ * skin_image on every draw. While the window size doesn't match scaled_width
+ * and scaled_height, painting falls back on scaling skin_image directly.
+ */
+struct ScaledImage {
+    cairo_surface_t *surface;
+    GdkRectangle rect;
+};
+
+static ScaledImage scaled_skin = { NULL };
+static ScaledImage *scaled_keys = NULL;
+static ScaledImage scaled_annunciators[7];
+static int scaled_nkeys = 0;
+static int scaled_width = -1, scaled_height = -1;
+
 
 /**********************************************************/
 /* Linked-in skins; defined in the skins.c, which in turn */
@@ -128,6 +150,12 @@ static void selectSkinCB(GtkWidget *w, gpointer cd);
 static bool skin_open(const char *name, bool open_layout, bool force_builtin);
 static int skin_gets(char *buf, int buflen);
 static void skin_close();
+static void skin_clear_layout();
+static bool skin_cache_load(const string &key);
+static void skin_cache_save(const string &key);
+static void free_scaled_cache();
+static bool scaled_cache_valid();
+static void paint_scaled_image(cairo_t *cr, const ScaledImage *img, const SkinRect *clip);
 
 
 static void addMenuItem(GtkMenu *menu, const char *name, bool enabled) {
@@ -181,18 +209,32 @@ static void selectSkinCB(GtkWidget *w, gpointer cd) {
     core_repaint_display();
 
     skin_set_window_size(sw, sh);
+    skin_update_scaled_cache();
     gtk_window_resize(GTK_WINDOW(mainwindow), sw, sh + menu_bar_height);
     gtk_widget_queue_draw(calc_widget);
 }
 
+/* Identifies the opened skin file for the decoded-skin cache */
+static void set_skin_file_id(const string &fname) {
+    struct stat st;
+    char buf[64];
+    if (fstat(fileno(external_file), &st) == 0)
+        snprintf(buf, 64, " %lld %lld\n", (long long) st.st_mtime, (long long) st.st_size);
+    else
+        strcpy(buf, " ? ?\n");
+    skin_file_id = fname + buf;
+}
+
 static bool skin_open(const char *name, bool open_layout, bool force_builtin) {
     if (!force_builtin) {
         const char *suffix = open_layout ? ".layout" : ".gif";
         // Try Free42 dir first...
         string fname = string(free42dirname) + "/" + name + suffix;
         external_file = fopen(fname.c_str(), "r");
-        if (external_file != NULL)
+        if (external_file != NULL) {
+            set_skin_file_id(fname);
             return true;
+        }
         // Next, shared dirs...
         const char *xdg_data_dirs = getenv("XDG_DATA_DIRS");
         if (xdg_data_dirs == NULL || xdg_data_dirs[0] == 0)
@@ -206,12 +248,14 @@ static bool skin_open(const char *name, bool open_layout, bool force_builtin) {
             external_file = fopen(fname.c_str(), "r");
             if (external_file != NULL) {
                 free(buf);
+                set_skin_file_id(fname);
                 return true;
             }
             fname = dirname + "/free42/skins/" + name + suffix;
             external_file = fopen(fname.c_str(), "r");
             if (external_file != NULL) {
                 free(buf);
+                set_skin_file_id(fname);
                 return true;
             }
             tok = strtok(NULL, ":");
@@ -231,6 +275,8 @@ static bool skin_open(const char *name, bool open_layout, bool force_builtin) {
                 builtin_length = skin_bitmap_size[i];
                 builtin_file = skin_bitmap_data[i];
             }
+            skin_file_id = string("builtin:") + name + (open_layout ? ".layout " : ".gif ")
+                    + VERSION + " " + std::to_string(builtin_length) + "\n";
             return true;
         }
     }
@@ -353,6 +399,242 @@ void skin_menu_update(GtkWidget *w) {
     }
 }
 
+static void skin_clear_layout() {
+    if (keylist != NULL)
+        free(keylist);
+    keylist = NULL;
+    nkeys = 0;
+    keys_cap = 0;
+
+    while (macrolist != NULL) {
+        SkinMacro *m = macrolist->next;
+        free(macrolist);
+        macrolist = m;
+    }
+
+    if (keymap != NULL)
+        free(keymap);
+    keymap = NULL;
+    keymap_length = 0;
+}
+
+/**********************/
+/* Decoded-skin cache */
+/**********************/
+
+/* The cache holds the parsed layout and the decoded RGB bitmap of the most
+ * recently loaded instance of each skin, in <free42dir>/skin-cache/<name>.
+ * The file starts with the cache key, so any change to the skin files, or to
+ * the Free42 build, causes a mismatch and a fall back on full decoding. The
+ * layout structures are stored in native format, so the cache is only valid
+ * for the executable that wrote it; the header includes the structure sizes
+ * as a safeguard.
+ * The bitmap is used in place, from the mmapped cache file.
+ */
+
+#define SKIN_CACHE_MAGIC "Free42 skin cache 1\n"
+
+struct skin_cache_header {
+    SkinRect skin;
+    SkinPoint display_loc;
+    double display_scale_x;
+    double display_scale_y;
+    bool display_scale_int;
+    SkinColor display_bg, display_fg;
+    SkinAnnunciator annunciators[7];
+    int nkeys;
+    int nmacros;
+    int keymap_length;
+    int image_width;
+    int image_height;
+    int image_rowstride;
+    int4 image_bytes;
+};
+
+struct skin_cache_map {
+    void *addr;
+    size_t length;
+};
+
+static string skin_cache_name() {
+    return string(free42dirname) + "/skin-cache/" + state.skinName;
+}
+
+static string skin_cache_full_key(const string &key) {
+    char buf[100];
+    snprintf(buf, 100, "%d %d %d %d\n", (int) sizeof(skin_cache_header),
+            (int) sizeof(SkinKey), (int) sizeof(SkinMacro), (int) sizeof(keymap_entry));
+    return string(SKIN_CACHE_MAGIC) + buf + key;
+}
+
+static void skin_cache_unmap(guchar *pixels, gpointer cd) {
+    skin_cache_map *map = (skin_cache_map *) cd;
+    munmap(map->addr, map->length);
+    delete map;
+}
+
+static bool skin_cache_load(const string &key) {
+    string fullkey = skin_cache_full_key(key);
+    int fd = open(skin_cache_name().c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < fullkey.length() + sizeof(skin_cache_header)) {
+        close(fd);
+        return false;
+    }
+    size_t length = st.st_size;
+    void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    const char *p = (const char *) addr;
+    const char *end = p + length;
+    skin_cache_header h;
+    size_t layout_size;
+    SkinKey *keys = NULL;
+    keymap_entry *km = NULL;
+    SkinMacro *macros = NULL;
+
+    if (memcmp(p, fullkey.c_str(), fullkey.length()) != 0)
+        goto mismatch;
+    p += fullkey.length();
+    memcpy(&h, p, sizeof(h));
+    p += sizeof(h);
+    if (h.nkeys < 0 || h.nmacros < 0 || h.keymap_length < 0
+            || h.image_width <= 0 || h.image_height <= 0
+            || h.image_rowstride < h.image_width * 3
+            || h.image_bytes < (int4) h.image_rowstride * (h.image_height - 1) + h.image_width * 3)
+        goto mismatch;
+    layout_size = h.nkeys * sizeof(SkinKey) + h.nmacros * sizeof(SkinMacro)
+                    + h.keymap_length * sizeof(keymap_entry);
+    if ((size_t) (end - p) != layout_size + h.image_bytes)
+        goto mismatch;
+
+    if (h.nkeys > 0) {
+        keys = (SkinKey *) malloc(h.nkeys * sizeof(SkinKey));
+        if (keys == NULL)
+            goto mismatch;
+        memcpy(keys, p, h.nkeys * sizeof(SkinKey));
+        p += h.nkeys * sizeof(SkinKey);
+    }
+    for (int i = 0; i < h.nmacros; i++) {
+        SkinMacro *m = (SkinMacro *) malloc(sizeof(SkinMacro));
+        if (m == NULL)
+            goto mismatch;
+        memcpy(m, p, sizeof(SkinMacro));
+        p += sizeof(SkinMacro);
+        m->next = macros;
+        macros = m;
+    }
+    if (h.keymap_length > 0) {
+        km = (keymap_entry *) malloc(h.keymap_length * sizeof(keymap_entry));
+        if (km == NULL)
+            goto mismatch;
+        memcpy(km, p, h.keymap_length * sizeof(keymap_entry));
+        p += h.keymap_length * sizeof(keymap_entry);
+    }
+
+    {
+        skin_cache_map *map = new skin_cache_map;
+        map->addr = addr;
+        map->length = length;
+        GdkPixbuf *image = gdk_pixbuf_new_from_data((const guchar *) p,
+                GDK_COLORSPACE_RGB, FALSE, 8, h.image_width, h.image_height,
+                h.image_rowstride, skin_cache_unmap, map);
+        if (image == NULL) {
+            delete map;
+            goto mismatch;
+        }
+        free_scaled_cache();
+        if (skin_image != NULL)
+            g_object_unref(skin_image);
+        skin_image = image;
+    }
+
+    skin_clear_layout();
+    skin = h.skin;
+    display_loc = h.display_loc;
+    display_scale_x = h.display_scale_x;
+    display_scale_y = h.display_scale_y;
+    display_scale_int = h.display_scale_int;
+    display_bg = h.display_bg;
+    display_fg = h.display_fg;
+    memcpy(annunciators, h.annunciators, sizeof(annunciators));
+    keylist = keys;
+    nkeys = keys_cap = h.nkeys;
+    // The macros were saved in list order, and reading them back reversed
+    // them; restore the original order.
+    while (macros != NULL) {
+        SkinMacro *m = macros->next;
+        macros->next = macrolist;
+        macrolist = macros;
+        macros = m;
+    }
+    keymap = km;
+    keymap_length = h.keymap_length;
+    return true;
+
+    mismatch:
+    free(keys);
+    free(km);
+    while (macros != NULL) {
+        SkinMacro *m = macros->next;
+        free(macros);
+        macros = m;
+    }
+    munmap(addr, length);
+    return false;
+}
+
+static void skin_cache_save(const string &key) {
+    string dirname = string(free42dirname) + "/skin-cache";
+    mkdir(dirname.c_str(), 0755);
+    string name = skin_cache_name();
+    // Write to a temporary file and rename it into place, so that other
+    // instances starting at the same time never see a partial cache file
+    char suffix[32];
+    snprintf(suffix, 32, ".%d.tmp", (int) getpid());
+    string tmpname = name + suffix;
+    FILE *f = fopen(tmpname.c_str(), "w");
+    if (f == NULL)
+        return;
+
+    string fullkey = skin_cache_full_key(key);
+    skin_cache_header h;
+    memset(&h, 0, sizeof(h));
+    h.skin = skin;
+    h.display_loc = display_loc;
+    h.display_scale_x = display_scale_x;
+    h.display_scale_y = display_scale_y;
+    h.display_scale_int = display_scale_int;
+    h.display_bg = display_bg;
+    h.display_fg = display_fg;
+    memcpy(h.annunciators, annunciators, sizeof(annunciators));
+    h.nkeys = nkeys;
+    h.nmacros = 0;
+    for (SkinMacro *m = macrolist; m != NULL; m = m->next)
+        h.nmacros++;
+    h.keymap_length = keymap_length;
+    h.image_width = gdk_pixbuf_get_width(skin_image);
+    h.image_height = gdk_pixbuf_get_height(skin_image);
+    h.image_rowstride = gdk_pixbuf_get_rowstride(skin_image);
+    h.image_bytes = h.image_rowstride * (h.image_height - 1) + h.image_width * 3;
+
+    bool ok = fwrite(fullkey.c_str(), 1, fullkey.length(), f) == fullkey.length()
+            && fwrite(&h, 1, sizeof(h), f) == sizeof(h)
+            && fwrite(keylist, sizeof(SkinKey), nkeys, f) == (size_t) nkeys;
+    for (SkinMacro *m = macrolist; ok && m != NULL; m = m->next)
+        ok = fwrite(m, 1, sizeof(SkinMacro), f) == sizeof(SkinMacro);
+    ok = ok && fwrite(keymap, sizeof(keymap_entry), keymap_length, f) == (size_t) keymap_length
+            && fwrite(gdk_pixbuf_get_pixels(skin_image), 1, h.image_bytes, f) == (size_t) h.image_bytes;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmpname.c_str(), name.c_str()) != 0)
+        remove(tmpname.c_str());
+}
+
 void skin_load(int *width, int *height) {
     char line[1024];
     bool force_builtin = false;
@@ -363,6 +645,30 @@ void skin_load(int *width, int *height) {
         force_builtin = true;
     }
 
+    /******************************/
+    /* Try the decoded-skin cache */
+    /******************************/
+
+    /* The cache key is made from the locations, modification times, and
+     * sizes of the layout and bitmap files.
+     */
+
+    if (!skin_open(state.skinName, 1, force_builtin))
+        goto fallback_on_1st_builtin_skin;
+    skin_close();
+    string cache_key = skin_file_id;
+    if (!skin_open(state.skinName, 0, force_builtin))
+        goto fallback_on_1st_builtin_skin;
+    skin_close();
+    cache_key += skin_file_id;
+
+    if (skin_cache_load(cache_key)) {
+        *width = skin.width;
+        *height = skin.height;
+        memset(disp_bits, 0, 272);
+        return;
+    }
+
     /*************************/
     /* Load skin description */
     /*************************/
@@ -370,22 +676,7 @@ void skin_load(int *width, int *height) {
     if (!skin_open(state.skinName, 1, force_builtin))
         goto fallback_on_1st_builtin_skin;
 
-    if (keylist != NULL)
-        free(keylist);
-    keylist = NULL;
-    nkeys = 0;
-    keys_cap = 0;
-
-    while (macrolist != NULL) {
-        SkinMacro *m = macrolist->next;
-        free(macrolist);
-        macrolist = m;
-    }
-
-    if (keymap != NULL)
-        free(keymap);
-    keymap = NULL;
-    keymap_length = 0;
+    skin_clear_layout();
     int kmcap = 0;
 
     int lineno = 0;
@@ -585,6 +876,8 @@ void skin_load(int *width, int *height) {
     if (!success)
         goto fallback_on_1st_builtin_skin;
 
+    skin_cache_save(cache_key);
+
     *width = skin.width;
     *height = skin.height;
 
@@ -597,6 +890,7 @@ void skin_load(int *width, int *height) {
 
 bool skin_init_image(int type, int ncolors, const SkinColor *colors,
                      int width, int height) {
+    free_scaled_cache();
     if (skin_image != NULL) {
         g_object_unref(skin_image);
         skin_image = NULL;
@@ -658,6 +952,10 @@ void skin_finish_image() {
 }
 
 void skin_repaint(cairo_t *cr) {
+    if (scaled_cache_valid()) {
+        paint_scaled_image(cr, &scaled_skin, NULL);
+        return;
+    }
     cairo_save(cr);
     gdk_cairo_set_source_pixbuf(cr, skin_image, -skin.x, -skin.y);
     cairo_rectangle(cr, 0, 0, skin.width, skin.height);
@@ -668,6 +966,10 @@ void skin_repaint(cairo_t *cr) {
 
 void skin_repaint_annunciator(cairo_t *cr, int which) {
     SkinAnnunciator *ann = annunciators + (which - 1);
+    if (scaled_cache_valid()) {
+        paint_scaled_image(cr, scaled_annunciators + (which - 1), &ann->disp_rect);
+        return;
+    }
     cairo_save(cr);
     gdk_cairo_set_source_pixbuf(cr, skin_image,
             ann->disp_rect.x - ann->src.x,
@@ -888,12 +1190,16 @@ void skin_make_darker(cairo_t *cr) {
     cairo_fill(cr);
 }
 
+static void scale_rect(int x, int y, int width, int height, GdkRectangle *scaled_rect) {
+    scaled_rect->x = (int) (((double) x) * window_width / skin.width);
+    scaled_rect->y = (int) (((double) y) * window_height / skin.height);
+    scaled_rect->width = (int) ceil(((double) width) * window_width / skin.width);
+    scaled_rect->height = (int) ceil(((double) height) * window_height / skin.height);
+}
+
 static void scaled_gdk_window_invalidate_rect(GdkWindow *win, const GdkRectangle *rect, gboolean invalidate_children) {
     GdkRectangle scaled_rect;
-    scaled_rect.x = (int) (((double) rect->x) * window_width / skin.width);
-    scaled_rect.y = (int) (((double) rect->y) * window_height / skin.height);
-    scaled_rect.width = (int) ceil(((double) rect->width) * window_width / skin.width);
-    scaled_rect.height = (int) ceil(((double) rect->height) * window_height / skin.height);
+    scale_rect(rect->x, rect->y, rect->width, rect->height, &scaled_rect);
     gdk_window_invalidate_rect(win, &scaled_rect, invalidate_children);
 }
 
@@ -1036,6 +1342,10 @@ void skin_repaint_key(cairo_t *cr, int key, bool state) {
     if (key < 0 || key >= nkeys)
         return;
     k = keylist + key;
+    if (scaled_cache_valid()) {
+        paint_scaled_image(cr, state ? scaled_keys + key : &scaled_skin, &k->disp_rect);
+        return;
+    }
     if (state)
         gdk_cairo_set_source_pixbuf(cr, skin_image,
                 k->disp_rect.x - k->src.x,
@@ -1146,3 +1456,125 @@ void skin_get_window_size(int *width, int *height) {
     *width = window_width;
     *height = window_height;
 }
+
+/**********************/
+/* Scaled-image cache */
+/**********************/
+
+static void free_scaled_cache() {
+    if (scaled_skin.surface != NULL) {
+        cairo_surface_destroy(scaled_skin.surface);
+        scaled_skin.surface = NULL;
+    }
+    for (int i = 0; i < scaled_nkeys; i++)
+        if (scaled_keys[i].surface != NULL)
+            cairo_surface_destroy(scaled_keys[i].surface);
+    free(scaled_keys);
+    scaled_keys = NULL;
+    scaled_nkeys = 0;
+    for (int i = 0; i < 7; i++)
+        if (scaled_annunciators[i].surface != NULL) {
+            cairo_surface_destroy(scaled_annunciators[i].surface);
+            scaled_annunciators[i].surface = NULL;
+        }
+    scaled_width = -1;
+    scaled_height = -1;
+}
+
+static bool scaled_cache_valid() {
+    return scaled_skin.surface != NULL
+            && scaled_width == window_width
+            && scaled_height == window_height;
+}
+
+/* Renders the part of the skin covered by 'rect' (in skin coordinates) at
+ * window scale: the background skin image, with the area 'clip' replaced by
+ * the image at 'src', if 'clip' is not NULL.
+ */
+static bool make_scaled_image(GdkWindow *win, ScaledImage *img,
+                              int x, int y, int width, int height,
+                              const SkinRect *clip, const SkinPoint *src) {
+    scale_rect(x, y, width, height, &img->rect);
+    if (img->rect.width <= 0 || img->rect.height <= 0) {
+        img->surface = NULL;
+        return true;
+    }
+    // Scale factor 0 means: use the window's scale factor, so that the cache
+    // has full resolution on HiDPI screens
+    img->surface = gdk_window_create_similar_image_surface(win,
+                CAIRO_FORMAT_RGB24, img->rect.width, img->rect.height, 0);
+    if (cairo_surface_status(img->surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(img->surface);
+        img->surface = NULL;
+        return false;
+    }
+    cairo_t *cr = cairo_create(img->surface);
+    cairo_translate(cr, -img->rect.x, -img->rect.y);
+    cairo_scale(cr, ((double) window_width) / skin.width, ((double) window_height) / skin.height);
+    gdk_cairo_set_source_pixbuf(cr, skin_image, -skin.x, -skin.y);
+    cairo_paint(cr);
+    if (clip != NULL) {
+        cairo_rectangle(cr, clip->x, clip->y, clip->width, clip->height);
+        cairo_clip(cr);
+        gdk_cairo_set_source_pixbuf(cr, skin_image, clip->x - src->x, clip->y - src->y);
+        cairo_paint(cr);
+    }
+    cairo_destroy(cr);
+    return true;
+}
+
+void skin_update_scaled_cache() {
+    if (scaled_cache_valid() || skin_image == NULL
+            || window_width <= 0 || window_height <= 0)
+        return;
+    GdkWindow *win = gtk_widget_get_window(calc_widget);
+    if (win == NULL)
+        return;
+    free_scaled_cache();
+
+    if (!make_scaled_image(win, &scaled_skin, 0, 0, skin.width, skin.height, NULL, NULL))
+        goto failed;
+    scaled_keys = (ScaledImage *) malloc(nkeys * sizeof(ScaledImage));
+    if (nkeys > 0 && scaled_keys == NULL)
+        goto failed;
+    for (int i = 0; i < nkeys; i++) {
+        SkinKey *k = keylist + i;
+        if (!make_scaled_image(win, scaled_keys + i, k->disp_rect.x, k->disp_rect.y,
+                    k->disp_rect.width, k->disp_rect.height, &k->disp_rect, &k->src))
+            goto failed;
+        scaled_nkeys++;
+    }
+    for (int i = 0; i < 7; i++) {
+        SkinAnnunciator *ann = annunciators + i;
+        if (!make_scaled_image(win, scaled_annunciators + i, ann->disp_rect.x, ann->disp_rect.y,
+                    ann->disp_rect.width, ann->disp_rect.height, &ann->disp_rect, &ann->src))
+            goto failed;
+    }
+
+    scaled_width = window_width;
+    scaled_height = window_height;
+    return;
+
+    failed:
+    free_scaled_cache();
+}
+
+/* Paints a pre-scaled image; 'clip', if not NULL, is in skin coordinates.
+ * The cairo context is scaled to skin coordinates by draw_cb(), so that
+ * scaling is undone here, to make the image map 1:1 to the window.
+ */
+static void paint_scaled_image(cairo_t *cr, const ScaledImage *img, const SkinRect *clip) {
+    if (img->surface == NULL)
+        return;
+    cairo_save(cr);
+    if (clip != NULL) {
+        cairo_rectangle(cr, clip->x, clip->y, clip->width, clip->height);
+        cairo_clip(cr);
+    }
+    cairo_scale(cr, ((double) skin.width) / window_width, ((double) skin.height) / window_height);
+    cairo_set_source_surface(cr, img->surface, img->rect.x, img->rect.y);
+    cairo_rectangle(cr, img->rect.x, img->rect.y, img->rect.width, img->rect.height);
+    cairo_clip(cr);
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
@@ -59,5 +59,6 @@ void skin_repaint_display(cairo_t *cr);
 void skin_get_size(int *width, int *height);
 void skin_set_window_size(int width, int height);
 void skin_get_window_size(int *width, int *height);
+void skin_update_scaled_cache();
 
 #endif